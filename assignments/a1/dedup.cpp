@@ -0,0 +1,525 @@
+// dedup.cpp
+
+//
+// Removes duplicate lines from a file without sorting it first. Each line is
+// printed the first time it appears, so the output is in the same order as
+// the input:
+//
+//   > ./dedup names.txt
+//
+//   ./dedup [filename] [-u|-d] [--memory-limit size]
+//     -u: only print lines that appear exactly once
+//     -d: only print lines that appear more than once (printing each once)
+//     --memory-limit: keep the lines seen so far in about size bytes of
+//                     memory (e.g. 500M or 2G), and use temporary files in
+//                     $TMPDIR (or /tmp) for the rest
+//
+// With no file name, cin is read. At the end, the number of lines, different
+// lines and duplicate lines is printed to cerr:
+//
+//   > ./dedup tiny_shakespeare.txt > /dev/null
+//   40000 lines: 25722 different, 14278 duplicates
+//
+// Unlike sort | uniq, this reads the input once from start to end with
+// cmpt::Tokenizer (see cmpt_tokenizer.h) and prints each new line as soon as
+// it's found.
+//
+// Hash Set
+// --------
+// The lines seen so far are kept in a hash table with open addressing (like
+// the word table in count_chars12.cpp). Each line is stored once, in one big
+// arena of chars, along with a 64-bit hash of it, its number in the input (its
+// first occurrence) and how many times it has been seen. Two lines are only
+// compared character by character when their hashes are the same, and that
+// comparison means two different lines with the same hash are never mistaken
+// for each other.
+//
+// Spilling to Disk
+// ----------------
+// If the table would grow past --memory-limit, no more lines are added to it.
+// Lines already in it are still recognized, but every other line is written,
+// with its line number, to one of a number of *partition* files picked by the
+// line's hash. All copies of a line have the same hash, so they all go to the
+// same partition, and each partition can then be de-duplicated on its own, in
+// memory, once the input has all been read. The partitions' results are then
+// merged by line number, so the output is still in first-occurrence order.
+//
+// The memory limit covers the hash set's three vectors: the entries, the
+// table of slots, and the arena. Each is counted at its whole capacity, and a
+// line isn't added if growing a vector for it (which briefly needs both its
+// old array and a new one twice as big) would go over the limit. The number of
+// partitions is picked so that each partition's set is expected to take half
+// the limit: the memory the set used per byte of input it read is measured,
+// and the rest of the input is assumed to be like that (there are 64
+// partitions if the input's size isn't known). Besides the set, dedup uses a
+// few MB for file buffers.
+//
+// The temporary directory is removed when dedup is done, and also if it's
+// killed by Ctrl-C, by kill, or by writing to a closed pipe (see
+// cmpt_temp_dir.h).
+//
+
+#include "cmpt_size.h"
+#include "cmpt_temp_dir.h"
+#include "cmpt_tokenizer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+// Which lines to print.
+enum class Mode
+{
+    all,        // one copy of every different line
+    unique,     // -u: lines that appear once
+    duplicated, // -d: one copy of lines that appear more than once
+};
+
+//
+// A fast 64-bit hash of a line, 8 bytes at a time.
+//
+uint64_t hash_line(string_view line)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15;
+    uint64_t h = line.size();
+    const char *p = line.data();
+    const char *end = p + line.size();
+    for (; end - p >= 8; p += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (((h << 5) | (h >> 59)) ^ word) * k;
+    }
+    uint64_t last = 0;
+    memcpy(&last, p, end - p);
+    h = (((h << 5) | (h >> 59)) ^ last) * k;
+    return h ^ (h >> 32);
+}
+
+//
+// The set of lines seen so far. See "Hash Set" at the top of the file. The
+// entries are kept in the order they were added, i.e. in order of line number.
+//
+class Line_set
+{
+public:
+    struct Entry
+    {
+        uint64_t hash;
+        size_t offset; // where the line starts in arena
+        size_t length;
+        long long line_num;
+        long long count;
+    };
+
+private:
+    vector<Entry> entries;
+    vector<size_t> slots; // entry index + 1, or 0 for an empty slot
+    vector<char> arena;
+
+    void grow()
+    {
+        slots.assign(2 * slots.size(), 0);
+        const size_t mask = slots.size() - 1;
+        for (size_t e = 0; e < entries.size(); e++)
+        {
+            size_t i = entries[e].hash & mask;
+            while (slots[i] != 0)
+                i = (i + 1) & mask;
+            slots[i] = e + 1;
+        }
+    }
+
+public:
+    Line_set()
+        : slots(1024, 0)
+    {
+    }
+
+    // Returns the entry for line, which has the given hash, or nullptr if it
+    // isn't in the set.
+    Entry *find(string_view line, uint64_t hash)
+    {
+        const size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask)
+        {
+            Entry &e = entries[slots[i] - 1];
+            if (e.hash == hash && e.length == line.size() &&
+                memcmp(arena.data() + e.offset, line.data(), line.size()) == 0)
+                return &e;
+        }
+        return nullptr;
+    }
+
+    // Adds line, which must not already be in the set.
+    void insert(string_view line, uint64_t hash, long long line_num, long long count = 1)
+    {
+        const size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        entries.push_back(Entry{hash, arena.size(), line.size(), line_num, count});
+        slots[i] = entries.size();
+        arena.insert(arena.end(), line.begin(), line.end());
+        if (2 * entries.size() > slots.size())
+            grow();
+    }
+
+    // The memory the set uses: the whole capacity of each of its vectors.
+    long long memory() const
+    {
+        return entries.capacity() * sizeof(Entry) + slots.size() * sizeof(size_t) +
+               arena.capacity();
+    }
+
+    // The most memory the set would use while adding line. A vector
+    // that grows allocates a new array twice as big before freeing the old
+    // one, so for a moment it takes three times its old capacity.
+    long long memory_after_adding(string_view line) const
+    {
+        long long peak = memory();
+        if (entries.size() == entries.capacity())
+            peak += 2 * max<size_t>(1, entries.capacity()) * sizeof(Entry);
+        if (arena.size() + line.size() > arena.capacity())
+            peak += max(2 * arena.capacity(), arena.size() + line.size());
+        if (2 * (entries.size() + 1) > slots.size())
+            peak += 2 * slots.size() * sizeof(size_t);
+        return peak;
+    }
+
+    string_view line_of(const Entry &e) const
+    {
+        return string_view(arena.data() + e.offset, e.length);
+    }
+
+    size_t size() const { return entries.size(); }
+    const vector<Entry> &in_order() const { return entries; }
+}; // class Line_set
+
+bool should_print(Mode mode, long long count)
+{
+    return mode == Mode::all || (mode == Mode::unique && count == 1) ||
+           (mode == Mode::duplicated && count > 1);
+}
+
+//
+// A temporary directory holding the partition files, and a result file for
+// each partition. Everything is removed when the Partition_dir is destroyed,
+// or if dedup is killed by a signal (see cmpt_temp_dir.h).
+//
+class Partition_dir
+{
+    cmpt::Temp_dir dir{"dedup"};
+    vector<string> fnames;
+
+public:
+    Partition_dir(int num_partitions)
+    {
+        for (int i = 0; i < num_partitions; i++)
+        {
+            fnames.push_back(dir.file("partition" + to_string(i + 1)));
+        }
+    }
+
+    int size() const { return fnames.size(); }
+    const string &partition(int i) const { return fnames[i]; }
+    string result(int i) const { return fnames[i] + ".result"; }
+}; // class Partition_dir
+
+// A line in a partition or result file: its line number, the number of times
+// it appears (in a result file), and the line itself.
+struct Record
+{
+    long long line_num = 0;
+    long long count = 0;
+    string line;
+};
+
+void write_record(ostream &out, long long line_num, long long count, string_view line)
+{
+    uint64_t length = line.size();
+    out.write(reinterpret_cast<const char *>(&line_num), sizeof(line_num));
+    out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    out.write(line.data(), line.size());
+}
+
+bool read_record(istream &in, Record &r)
+{
+    uint64_t length = 0;
+    in.read(reinterpret_cast<char *>(&r.line_num), sizeof(r.line_num));
+    in.read(reinterpret_cast<char *>(&r.count), sizeof(r.count));
+    in.read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (!in)
+        return false;
+    r.line.resize(length);
+    in.read(&r.line[0], length);
+    return bool(in);
+}
+
+// De-duplicate one partition, and write a result record for each different
+// line in it, in order of line number.
+void dedup_partition(const string &fname, const string &result_fname)
+{
+    Line_set seen;
+    ifstream in(fname, ios::binary);
+    if (!in)
+        throw runtime_error("unable to read temporary file " + fname);
+    Record r;
+    while (read_record(in, r))
+    {
+        uint64_t hash = hash_line(r.line);
+        Line_set::Entry *e = seen.find(r.line, hash);
+        if (e != nullptr)
+            e->count++;
+        else
+            seen.insert(r.line, hash, r.line_num);
+    }
+
+    ofstream out(result_fname, ios::binary);
+    for (const Line_set::Entry &e : seen.in_order())
+    {
+        write_record(out, e.line_num, e.count, seen.line_of(e));
+    }
+    if (!out)
+        throw runtime_error("unable to write temporary file " + result_fname);
+}
+
+// Merges the result files of the partitions by line number, and prints the
+// lines chosen by mode. Returns the number of different lines.
+long long merge_results(const Partition_dir &parts, Mode mode, ostream &out)
+{
+    struct Entry
+    {
+        Record record;
+        int partition;
+    };
+    auto after = [](const Entry &a, const Entry &b)
+    { return a.record.line_num > b.record.line_num; };
+    priority_queue<Entry, vector<Entry>, decltype(after)> heap(after);
+
+    vector<ifstream> inputs(parts.size());
+    for (int p = 0; p < parts.size(); p++)
+    {
+        inputs[p].open(parts.result(p), ios::binary);
+        if (!inputs[p])
+            throw runtime_error("unable to read temporary file " + parts.result(p));
+        Entry e{Record(), p};
+        if (read_record(inputs[p], e.record))
+            heap.push(e);
+    }
+
+    long long num_different = 0;
+    while (!heap.empty())
+    {
+        Entry e = heap.top();
+        heap.pop();
+        num_different++;
+        if (should_print(mode, e.record.count))
+            out << e.record.line << "\n";
+        if (read_record(inputs[e.partition], e.record))
+            heap.push(e);
+    }
+    return num_different;
+}
+
+struct Dedup_stats
+{
+    long long num_lines = 0;
+    long long num_different = 0;
+    int num_partitions = 0; // 0 if nothing was spilled to disk
+};
+
+//
+// Reads the lines from in, and prints the ones chosen by mode to out. If
+// memory_limit is more than 0, the hash set is kept to about that size (see
+// "Spilling to Disk" at the top of the file); input_size is the size of the
+// input in bytes, or 0 if it isn't known.
+//
+Dedup_stats dedup(cmpt::Tokenizer &in, Mode mode, long long memory_limit, long long input_size,
+                  ostream &out)
+{
+    Dedup_stats stats;
+    Line_set seen;
+    unique_ptr<Partition_dir> parts;
+    vector<ofstream> partition_files;
+
+    long long bytes_read = 0;
+    string_view line;
+    while (in.next(line))
+    {
+        bytes_read += line.size() + 1;
+        const long long line_num = stats.num_lines++;
+        const uint64_t hash = hash_line(line);
+        Line_set::Entry *e = seen.find(line, hash);
+        if (e != nullptr)
+        {
+            e->count++;
+        }
+        else if (parts == nullptr &&
+                 (memory_limit == 0 || seen.memory_after_adding(line) <= memory_limit))
+        {
+            seen.insert(line, hash, line_num);
+            if (mode == Mode::all)
+                out << line << "\n";
+        }
+        else
+        {
+            if (parts == nullptr)
+            {
+                // the set is full, so start spilling to disk; the rest of
+                // the input is expected to need as much memory per byte as
+                // the part in the set did, and twice that is allowed for
+                // partitions getting more than their share
+                const int max_partitions = 512;
+                int n = 64;
+                if (input_size > 0)
+                {
+                    double per_byte = double(seen.memory()) / bytes_read;
+                    double needed = 2 * per_byte * max(0LL, input_size - bytes_read);
+                    n = min<double>(max_partitions, max(2.0, needed / memory_limit + 1));
+                }
+                parts = make_unique<Partition_dir>(n);
+                partition_files.resize(n);
+                for (int p = 0; p < n; p++)
+                {
+                    partition_files[p].open(parts->partition(p), ios::binary);
+                }
+                stats.num_partitions = n;
+            }
+            write_record(partition_files[(hash >> 32) % parts->size()], line_num, 0, line);
+        }
+    }
+
+    // every line in the set came before every spilled line, so with -u and
+    // -d, the set's lines are printed first
+    stats.num_different = seen.size();
+    if (mode != Mode::all)
+    {
+        for (const Line_set::Entry &e : seen.in_order())
+        {
+            if (should_print(mode, e.count))
+                out << seen.line_of(e) << "\n";
+        }
+    }
+
+    if (parts != nullptr)
+    {
+        // the set's memory is needed for the partitions
+        seen = Line_set();
+        for (int p = 0; p < parts->size(); p++)
+        {
+            partition_files[p].close();
+            if (!partition_files[p])
+                throw runtime_error("unable to write temporary file " + parts->partition(p));
+            dedup_partition(parts->partition(p), parts->result(p));
+            remove(parts->partition(p).c_str());
+        }
+        stats.num_different += merge_results(*parts, mode, out);
+    }
+    return stats;
+} // dedup
+
+void usage()
+{
+    cout << "Usage: ./dedup [filename] [-u|-d] [--memory-limit size]\n";
+    cout << "  -u: only print lines that appear exactly once\n";
+    cout << "  -d: only print lines that appear more than once\n";
+    cout << "  --memory-limit: use at most about size bytes of memory for the\n";
+    cout << "                  lines seen so far, e.g. 500M or 2G, with temporary\n";
+    cout << "                  files in $TMPDIR\n";
+}
+
+int main(int argc, char *argv[])
+{
+    // cout is only used through C++ streams, so it needn't stay in step with C
+    // stdio; this makes writing lots of short lines much faster
+    ios_base::sync_with_stdio(false);
+
+    Mode mode = Mode::all;
+    long long memory_limit = 0;
+    string fname;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-u")
+        {
+            mode = Mode::unique;
+        }
+        else if (arg == "-d")
+        {
+            mode = Mode::duplicated;
+        }
+        else if (arg == "--memory-limit")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            memory_limit = cmpt::parse_size(value);
+            if (memory_limit == 0)
+            {
+                cout << "Error: invalid memory limit \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+        }
+        else if (fname.empty() && arg[0] != '-')
+        {
+            fname = arg;
+        }
+        else
+        {
+            cout << "Error: unknown option \"" << arg << "\"\n";
+            usage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        // the input is read in blocks, not mapped, so that lines that have
+        // been read don't stay in memory
+        unique_ptr<cmpt::Tokenizer> in;
+        long long input_size = 0;
+        if (fname.empty())
+        {
+            in = make_unique<cmpt::Tokenizer>(0, cmpt::Tokenizer::lines);
+        }
+        else
+        {
+            in = make_unique<cmpt::Tokenizer>(fname, cmpt::Tokenizer::lines, false);
+            if (!in->is_open())
+            {
+                cout << "Error: unable to open file \"" << fname << "\"\n";
+                return 1;
+            }
+            struct stat info;
+            if (stat(fname.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+                input_size = info.st_size;
+        }
+
+        Dedup_stats stats = dedup(*in, mode, memory_limit, input_size, cout);
+        cout.flush();
+        cerr << stats.num_lines << " lines: " << stats.num_different << " different, "
+             << stats.num_lines - stats.num_different << " duplicates";
+        if (stats.num_partitions > 0)
+            cerr << " (spilled to " << stats.num_partitions << " partitions)";
+        cerr << "\n";
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
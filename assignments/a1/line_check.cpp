@@ -10,6 +10,7 @@
 // 15 is too long: 106 characters".
 //
 
+#include "cmpt_block_reader.h"
 #include <iostream>
 
 using namespace std;
@@ -22,8 +23,9 @@ int main()
     int current_line_length = 0;
     int num_long_lines = 0;
 
+    cmpt::Block_reader in; // reads cin in large blocks
     char c;
-    while (cin.get(c))
+    while (in.get(c))
     {
         if (c == '\n')
         {
@@ -22,11 +22,51 @@
 //
 /////////////////////////////////////////////////////////////////////////
 
+//
+// Checks if any lines in a file are longer than 100 characters, and prints the
+// length of each line that is too long:
+//
+//   > ./line_check_a1 < sample_lines.txt
+//   Line 4 is too long: 101 characters
+//   Line 6 is too long: 110 characters
+//
+
+#include "cmpt_block_reader.h"
 #include <iostream>
 
 using namespace std;
 
 int main()
 {
-    cout << "Hello from line_check_a1.cpp !" << endl;
-}
+    const int max_line_length = 100;
+
+    int line_num = 1;
+    int current_line_length = 0;
+    int num_long_lines = 0;
+
+    cmpt::Block_reader in; // reads cin in large blocks
+    char c;
+    while (in.get(c))
+    {
+        if (c == '\n')
+        {
+            if (current_line_length > max_line_length)
+            {
+                cout << "Line " << line_num << " is too long: " << current_line_length
+                     << " characters\n";
+                num_long_lines++;
+            }
+            line_num++;
+            current_line_length = 0;
+        }
+        else
+        {
+            current_line_length++;
+        }
+    } // while
+
+    if (num_long_lines == 0)
+    {
+        cout << "No lines are too long.\n";
+    }
+} // main
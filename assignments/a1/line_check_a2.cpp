@@ -22,11 +22,535 @@
 //
 /////////////////////////////////////////////////////////////////////////
 
+//
+// Checks if any lines in a file are longer than a given maximum length, and
+// prints the length of each line that is too long. The maximum length is an
+// optional command-line argument, and is 100 if not given:
+//
+//   > ./line_check_a2 100 < sample_lines.txt
+//   Line 4 is too long: 101 characters
+//   Line 6 is too long: 110 characters
+//
+//   > ./line_check_a2 200 < sample_lines.txt
+//   No lines are too long.
+//
+// Instead of looking at every character, the ends of lines are found using
+// memchr, which uses SIMD instructions to search for '\n' many bytes at a time.
+//
+// When the input is re-directed from a file it is memory-mapped, and the
+// option -j (up to 1024 threads) splits it into chunks of about 1MB that are
+// checked at the same time on different threads:
+//
+//   > ./line_check_a2 -j 4 100 < sample_lines.txt
+//   Line 4 is too long: 101 characters
+//   Line 6 is too long: 110 characters
+//
+// Each chunk is checked using line numbers that start at 0, and then the
+// number of lines in all the chunks before it is added to get the real line
+// numbers. The chunks are printed in order as they finish, so memory use
+// doesn't grow with the number of long lines. If the input can't be mapped,
+// e.g. it's a pipe, then it's read in blocks on a single thread.
+//
+// Normally the length of a line is the number of bytes in it. But in UTF-8
+// files, characters like é or 日 take more than one byte, and so the option
+// --codepoints measures length in code points (i.e. characters) instead:
+//
+//   > ./line_check_a2 --codepoints 100 < sample_lines_utf8.txt
+//   Line 2 is too long: 101 characters
+//   Line 4 is too long: 103 characters
+//
+// The option --histogram also counts how many lines have each length, in the
+// same pass over the input (each thread keeps its own counts for its chunk,
+// and they're added up at the end), and prints some percentiles of the line
+// lengths and the number of lines in each range of lengths:
+//
+//   > ./line_check_a2 --histogram 100 < sample_lines.txt
+//   Line 4 is too long: 101 characters
+//   Line 6 is too long: 110 characters
+//   Line lengths of 7 lines: p50 73, p90 110, p99 110, max 110
+//          0 -        0: 3
+//         64 -      127: 4
+//
+// A percentile p is the shortest length that at least p% of the lines are no
+// longer than.
+//
+
+#include "cmpt_block_reader.h"
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINE_CHECK_X86_SIMD
+#endif
 
 using namespace std;
 
-int main()
+// the most threads -j can ask for
+const int max_threads = 1024;
+
+void usage()
+{
+    cout << "Usage: ./line_check_a2 [-j num_threads] [--codepoints] [--histogram] [max_line_length]\n";
+}
+
+// Returns true if s is an integer that is 0 or bigger, e.g. "0" or "100".
+bool is_non_negative_int(const string &s)
+{
+    if (s.empty() || s.size() > 9)
+        return false;
+    for (char c : s)
+    {
+        if (c < '0' || c > '9')
+            return false;
+    }
+    return true;
+}
+
+//
+// Returns the number of UTF-8 continuation bytes from begin to end. Every code
+// point in UTF-8 is one leading byte followed by 0 to 3 continuation bytes of
+// the form 10xxxxxx, and so the number of code points is the number of bytes
+// minus the number of continuation bytes.
+//
+// As signed chars, the continuation bytes 0x80 to 0xBF are exactly the values
+// less than -64, and SSE2 can compare 16 bytes against -64 at once.
+//
+long long count_continuation_bytes(const char *begin, const char *end)
 {
-    cout << "Hello from line_check_a2.cpp !" << endl;
+    long long count = 0;
+    const char *p = begin;
+#ifdef LINE_CHECK_X86_SIMD
+    const __m128i limit = _mm_set1_epi8(-64);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(block, limit)));
+    }
+#endif
+    for (; p != end; p++)
+    {
+        if (static_cast<signed char>(*p) < -64)
+            count++;
+    }
+    return count;
 }
+
+struct Long_line
+{
+    long long line_num;
+    long long length;
+};
+
+//
+// The number of lines of each length. Lengths less than max_counted are
+// counted in an array, and the lengths of the (rare) longer lines are just
+// saved, so one huge line doesn't make the array huge.
+//
+class Histogram
+{
+    static const long long max_counted = 1 << 16;
+
+    vector<long long> counts;
+    vector<long long> long_lengths;
+    long long num_lines = 0;
+    long long max_length = 0;
+
+public:
+    void add(long long length)
+    {
+        if (length < max_counted)
+        {
+            if (length >= static_cast<long long>(counts.size()))
+                counts.resize(max(length + 1, 2 * static_cast<long long>(counts.size())));
+            counts[length]++;
+        }
+        else
+        {
+            long_lengths.push_back(length);
+        }
+        num_lines++;
+        max_length = max(max_length, length);
+    }
+
+    void merge(const Histogram &other)
+    {
+        if (other.counts.size() > counts.size())
+            counts.resize(other.counts.size());
+        for (size_t i = 0; i < other.counts.size(); i++)
+        {
+            counts[i] += other.counts[i];
+        }
+        long_lengths.insert(long_lengths.end(), other.long_lengths.begin(),
+                            other.long_lengths.end());
+        num_lines += other.num_lines;
+        max_length = max(max_length, other.max_length);
+    }
+
+    long long size() const { return num_lines; }
+    long long longest() const { return max_length; }
+
+    // Returns the shortest length that at least p% of the lines are no longer
+    // than. There must be at least one line.
+    long long percentile(int p)
+    {
+        const long long rank = max(1LL, (num_lines * p + 99) / 100);
+        long long seen = 0;
+        for (size_t length = 0; length < counts.size(); length++)
+        {
+            seen += counts[length];
+            if (seen >= rank)
+                return length;
+        }
+        sort(long_lengths.begin(), long_lengths.end());
+        return long_lengths[rank - seen - 1];
+    }
+
+    // Returns the number of lines with a length from low to high.
+    long long count_between(long long low, long long high) const
+    {
+        long long n = 0;
+        for (long long length = low; length <= high && length < static_cast<long long>(counts.size()); length++)
+        {
+            n += counts[length];
+        }
+        for (long long length : long_lengths)
+        {
+            if (length >= low && length <= high)
+                n++;
+        }
+        return n;
+    }
+}; // class Histogram
+
+// The result of checking one chunk of the input.
+struct Chunk_result
+{
+    long long num_lines = 0; // number of '\n' characters in the chunk
+    vector<Long_line> long_lines;
+    Histogram histogram;
+};
+
+//
+// Checks the lines from begin up to, but not including, end. The line starting
+// at begin is numbered first_line_num. Only lines that end with a '\n' are
+// checked, just like the original line_check.
+//
+// If codepoints is true, line lengths are measured in code points. A line never
+// has more code points than bytes, so code points only need to be counted for
+// lines whose byte length is too long, unless histogram is true, in which case
+// the length of every line is added to the result's histogram.
+//
+Chunk_result check_lines(const char *begin, const char *end, long long first_line_num,
+                         long long max_line_length, bool codepoints, bool histogram)
+{
+    Chunk_result result;
+    const char *line_start = begin;
+    for (;;)
+    {
+        const char *newline =
+            static_cast<const char *>(memchr(line_start, '\n', end - line_start));
+        if (newline == nullptr)
+            break;
+        long long length = newline - line_start;
+        if (codepoints && (length > max_line_length || histogram))
+            length -= count_continuation_bytes(line_start, newline);
+        if (length > max_line_length)
+            result.long_lines.push_back({first_line_num + result.num_lines, length});
+        if (histogram)
+            result.histogram.add(length);
+        result.num_lines++;
+        line_start = newline + 1;
+    }
+    return result;
+}
+
+void print_long_line(long long line_num, long long length)
+{
+    cout << "Line " << line_num << " is too long: " << length << " characters\n";
+}
+
+//
+// Checks the lines from begin to end using num_threads threads, and prints
+// each line that is too long. Returns the number of lines that are too long.
+//
+// The input is split into chunks of about chunk_size bytes, and each chunk
+// boundary is moved forward to just after the next '\n' so that no line is
+// split between two chunks. Each thread takes the next unchecked chunk and
+// checks it as if its first line was line 0. This thread prints the chunks'
+// long lines in order as they're done, fixing their line numbers by adding the
+// total number of lines in all the chunks before (i.e. the prefix sum of the
+// chunk line counts). The threads are never more than max_ahead chunks ahead
+// of the printing, so only a few chunks' results are ever in memory, however
+// many long lines the input has.
+//
+// If histogram isn't nullptr, the chunks' histograms are merged into it.
+//
+long long check_lines_parallel(const char *begin, const char *end, long long max_line_length,
+                               bool codepoints, int num_threads, Histogram *histogram)
+{
+    const long long chunk_size = 1 << 20;
+
+    vector<const char *> bounds = {begin};
+    while (bounds.back() != end)
+    {
+        const char *b = bounds.back() + min<long long>(chunk_size, end - bounds.back());
+        const char *newline = static_cast<const char *>(memchr(b, '\n', end - b));
+        bounds.push_back(newline == nullptr ? end : newline + 1);
+    }
+    const long long num_chunks = bounds.size() - 1;
+    const long long max_ahead = 4 * num_threads;
+
+    auto check_chunk = [&](long long i)
+    {
+        return check_lines(bounds[i], bounds[i + 1], 0, max_line_length, codepoints,
+                           histogram != nullptr);
+    };
+
+    // results[i % max_ahead] holds the result of chunk i until it's printed
+    vector<Chunk_result> results(max_ahead);
+    vector<char> done(max_ahead, false);
+    long long next_chunk = 0;
+    long long num_printed = 0;
+    mutex m;
+    condition_variable result_ready;
+    condition_variable room_ahead;
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            long long i;
+            {
+                unique_lock<mutex> lock(m);
+                room_ahead.wait(lock, [&]()
+                                { return next_chunk == num_chunks ||
+                                         next_chunk < num_printed + max_ahead; });
+                if (next_chunk == num_chunks)
+                    return;
+                i = next_chunk++;
+            }
+            Chunk_result r = check_chunk(i);
+            {
+                lock_guard<mutex> lock(m);
+                results[i % max_ahead] = move(r);
+                done[i % max_ahead] = true;
+            }
+            result_ready.notify_one();
+        }
+    };
+
+    // one thread doesn't need any others; and if the system won't start as
+    // many threads as asked for, the ones that did start do all the chunks
+    vector<thread> workers;
+    for (int t = 0; num_threads > 1 && t < min<long long>(num_threads, num_chunks); t++)
+    {
+        try
+        {
+            workers.push_back(thread(worker));
+        }
+        catch (const system_error &)
+        {
+            break;
+        }
+    }
+
+    long long num_long_lines = 0;
+    long long lines_before = 0;
+    for (long long i = 0; i < num_chunks; i++)
+    {
+        Chunk_result r;
+        if (workers.empty())
+        {
+            r = check_chunk(i);
+        }
+        else
+        {
+            {
+                unique_lock<mutex> lock(m);
+                result_ready.wait(lock, [&]()
+                                  { return bool(done[i % max_ahead]); });
+                r = move(results[i % max_ahead]);
+                done[i % max_ahead] = false;
+                num_printed++;
+            }
+            room_ahead.notify_all();
+        }
+
+        for (const Long_line &line : r.long_lines)
+        {
+            print_long_line(lines_before + line.line_num + 1, line.length);
+        }
+        num_long_lines += r.long_lines.size();
+        lines_before += r.num_lines;
+        if (histogram != nullptr)
+            histogram->merge(r.histogram);
+    }
+
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+    return num_long_lines;
+} // check_lines_parallel
+
+//
+// Checks the lines read from in, a block at a time, and prints each line that
+// is too long. Returns the number of lines that are too long.
+// current_line_length holds the length of the part of the current line that
+// was in earlier blocks. If histogram isn't nullptr, every line's length is
+// added to it.
+//
+long long check_lines_stream(cmpt::Block_reader &in, long long max_line_length, bool codepoints,
+                             Histogram *histogram)
+{
+    long long num_long_lines = 0;
+    long long line_num = 1;
+    long long current_line_length = 0;
+
+    const char *begin;
+    const char *end;
+    while (in.get_block(begin, end))
+    {
+        const char *line_start = begin;
+        for (;;)
+        {
+            const char *newline =
+                static_cast<const char *>(memchr(line_start, '\n', end - line_start));
+            if (newline == nullptr)
+                break;
+            current_line_length += newline - line_start;
+            if (codepoints)
+                current_line_length -= count_continuation_bytes(line_start, newline);
+            if (current_line_length > max_line_length)
+            {
+                print_long_line(line_num, current_line_length);
+                num_long_lines++;
+            }
+            if (histogram != nullptr)
+                histogram->add(current_line_length);
+            line_num++;
+            current_line_length = 0;
+            line_start = newline + 1;
+        }
+        current_line_length += end - line_start;
+        if (codepoints)
+            current_line_length -= count_continuation_bytes(line_start, end);
+    }
+    return num_long_lines;
+} // check_lines_stream
+
+//
+// Prints the percentiles of the line lengths in histogram, and the number of
+// lines whose length is 0, 1, 2-3, 4-7, 8-15, and so on.
+//
+void print_histogram(Histogram &histogram)
+{
+    if (histogram.size() == 0)
+    {
+        cout << "Line lengths: there are no lines.\n";
+        return;
+    }
+    cout << "Line lengths of " << histogram.size() << " lines: p50 " << histogram.percentile(50)
+         << ", p90 " << histogram.percentile(90) << ", p99 " << histogram.percentile(99)
+         << ", max " << histogram.longest() << "\n";
+
+    long long low = 0;
+    long long high = 0;
+    while (low <= histogram.longest())
+    {
+        long long n = histogram.count_between(low, high);
+        if (n > 0)
+            cout << setw(8) << low << " - " << setw(8) << high << ": " << n << "\n";
+        low = high + 1;
+        high = 2 * high + 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_threads = 1;
+    bool codepoints = false;
+    bool show_histogram = false;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-j")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            if (!is_non_negative_int(value) || stoi(value) < 1 || stoi(value) > max_threads)
+            {
+                cout << "Invalid number of threads: " << value << "\n";
+                usage();
+                return 1;
+            }
+            num_threads = stoi(value);
+        }
+        else if (arg == "--codepoints")
+        {
+            codepoints = true;
+        }
+        else if (arg == "--histogram")
+        {
+            show_histogram = true;
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() > 1)
+    {
+        cout << "Too many arguments.\n";
+        usage();
+        return 1;
+    }
+
+    long long max_line_length = 100;
+    if (args.size() == 1)
+    {
+        if (!is_non_negative_int(args[0]))
+        {
+            cout << "Invalid argument: " << args[0] << "\n";
+            usage();
+            return 1;
+        }
+        max_line_length = stoi(args[0]);
+    }
+
+    long long num_long_lines = 0;
+    Histogram histogram;
+    Histogram *histogram_ptr = show_histogram ? &histogram : nullptr;
+    cmpt::Mapped_file input(0); // standard input
+    if (input.is_open())
+    {
+        num_long_lines = check_lines_parallel(input.begin(), input.end(), max_line_length,
+                                              codepoints, num_threads, histogram_ptr);
+    }
+    else
+    {
+        cmpt::Block_reader in;
+        num_long_lines = check_lines_stream(in, max_line_length, codepoints, histogram_ptr);
+    }
+
+    if (num_long_lines == 0)
+    {
+        cout << "No lines are too long.\n";
+    }
+    if (show_histogram)
+    {
+        print_histogram(histogram);
+    }
+} // main
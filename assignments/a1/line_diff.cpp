@@ -0,0 +1,462 @@
+// line_diff.cpp
+
+//
+// Compares two files line by line, like the diff command, and prints the first
+// few groups of lines that differ ("hunks") in the same format as diff. It's
+// meant for checking that a program's output is right, e.g. that mysort sorts
+// correctly, when the files are too big for diff:
+//
+//   > ./mysort tiny_shakespeare.txt > out.txt
+//   > ./line_diff out.txt tiny_shakespeare_sorted.txt
+//   >
+//
+//   > ./line_diff -n 2 names.txt names_sorted.txt
+//   1c1,3
+//   < Rick
+//   ---
+//   > Beth
+//   > Evil Morty
+//   > Jerry
+//   2a5
+//   > Rick
+//   (stopped after 2 hunks; there are more differences)
+//
+//   ./line_diff [-n max_hunks] file1 file2
+//     -n: print at most max_hunks hunks (the default is 10); with -n 0,
+//         nothing is printed and only the exit status tells if the files are
+//         the same
+//
+// The exit status is 0 if the files have the same lines, 1 if they're
+// different, and 2 if there was an error.
+//
+// How it Works
+// ------------
+// Both files are memory-mapped (see cmpt_mapped_file.h), and the parts that
+// are the same are skipped by comparing them a megabyte at a time with memcmp,
+// counting lines as they go by. So two copies of the same file are found to be
+// the same very quickly, and a file that only differs near its end is mostly
+// just skipped. The pages that have been skipped are dropped from memory as
+// the comparison goes along.
+//
+// At the first byte that differs, the comparison backs up to the start of its
+// line, and the next window_lines lines of each file are hashed. The window
+// is compared using Eugene Myers' O(ND) diff algorithm ("An O(ND) Difference
+// Algorithm and Its Variations", 1986), which finds the fewest lines to delete
+// and insert to turn one sequence of lines into the other. Lines are compared
+// by hash first, and only compared character by character if their hashes are
+// the same, so different lines with the same hash are never taken to be the
+// same.
+//
+// The hunks of the edit script are printed, except for the last one if the
+// window doesn't reach the ends of the files, since it might continue past the
+// window. Then the comparison carries on after the last hunk printed, by
+// skipping the same bytes again. If the ends of the windows can't be reached
+// within max_edits edits, the edit script to the point that got furthest is
+// used instead. So the memory used depends on window_lines and max_edits, not
+// on the size of the files. The cost is that a hunk bigger than the window is
+// printed in pieces, and the edit script near the end of a window may not be
+// the shortest one for the whole file.
+//
+// A missing '\n' at the end of a file is ignored, so "a\nb" and "a\nb\n" are
+// the same.
+//
+
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+// the number of lines of each file compared at once by Myers' algorithm
+const int window_lines = 1 << 16;
+
+// the most edits (deletions plus insertions) Myers' algorithm searches for in
+// a window; the trace it keeps takes (max_edits + 1)^2 ints
+const int max_edits = 2048;
+
+//
+// One of the two files being compared. pos is the start of the first line
+// that hasn't been compared yet, and line_num is the number of lines before
+// it. Pages before pos are dropped from memory every drop_size bytes.
+//
+struct Input
+{
+    const char *begin;
+    const char *end;
+    const char *pos;
+    long long line_num = 0;
+    const char *dropped_to;
+
+    Input(const cmpt::Mapped_file &file)
+        : begin(file.begin()), end(file.end()), pos(file.begin()), dropped_to(file.begin())
+    {
+    }
+
+    size_t remaining() const { return end - pos; }
+
+    void advance(size_t n, long long num_lines)
+    {
+        const size_t drop_size = 64 << 20;
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        pos += n;
+        line_num += num_lines;
+        if (pos - dropped_to >= static_cast<long long>(drop_size))
+        {
+            // begin is page-aligned, since mmap maps from the start of a page
+            const char *to = begin + (pos - begin) / page_size * page_size;
+            madvise(const_cast<char *>(dropped_to), to - dropped_to, MADV_DONTNEED);
+            dropped_to = to;
+        }
+    }
+};
+
+//
+// Skips the lines at the start of a and b that are exactly the same, by
+// comparing a block of bytes at a time. Stops at the start of the line with
+// the first different byte. If a and b are the same all the way to the end,
+// both are moved to the end.
+//
+void skip_same(Input &a, Input &b)
+{
+    const size_t block_size = 1 << 20;
+    const size_t limit = min(a.remaining(), b.remaining());
+    size_t same = 0;      // the number of bytes known to be the same
+    size_t line_start = 0; // the start of the line that same is in
+    long long num_lines = 0;
+    while (same < limit)
+    {
+        const size_t n = min(block_size, limit - same);
+        size_t i = n;
+        if (memcmp(a.pos + same, b.pos + same, n) != 0)
+        {
+            i = 0;
+            while (a.pos[same + i] == b.pos[same + i])
+                i++;
+        }
+
+        const char *block_end = a.pos + same + i;
+        for (const char *p = a.pos + same; p != block_end; p++)
+        {
+            p = static_cast<const char *>(memchr(p, '\n', block_end - p));
+            if (p == nullptr)
+                break;
+            num_lines++;
+            line_start = p + 1 - a.pos;
+        }
+        same += i;
+        if (i < n)
+            break;
+    }
+
+    if (same == a.remaining() && same == b.remaining())
+        line_start = same;
+    a.advance(line_start, num_lines);
+    b.advance(line_start, num_lines);
+}
+
+struct Line
+{
+    string_view text;
+    uint64_t hash;
+};
+
+bool operator==(const Line &a, const Line &b)
+{
+    return a.hash == b.hash && a.text == b.text;
+}
+
+//
+// A fast 64-bit hash of a line, 8 bytes at a time.
+//
+uint64_t hash_line(string_view line)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15;
+    uint64_t h = line.size();
+    const char *p = line.data();
+    const char *end = p + line.size();
+    for (; end - p >= 8; p += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (((h << 5) | (h >> 59)) ^ word) * k;
+    }
+    uint64_t last = 0;
+    memcpy(&last, p, end - p);
+    h = (((h << 5) | (h >> 59)) ^ last) * k;
+    return h ^ (h >> 32);
+}
+
+// Returns the next window_lines lines of in (or fewer at the end of the file),
+// without moving in.pos. window_end is set to just after the last one.
+vector<Line> read_window(const Input &in, const char *&window_end)
+{
+    vector<Line> lines;
+    const char *p = in.pos;
+    while (p != in.end && lines.size() < window_lines)
+    {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', in.end - p));
+        const char *line_end = (newline == nullptr) ? in.end : newline;
+        string_view text(p, line_end - p);
+        lines.push_back(Line{text, hash_line(text)});
+        p = (newline == nullptr) ? in.end : newline + 1;
+    }
+    window_end = p;
+    return lines;
+}
+
+// Lines a_start up to a_end of a are replaced by lines b_start up to b_end of
+// b. Either range can be empty, but not both.
+struct Hunk
+{
+    int a_start, a_end;
+    int b_start, b_end;
+};
+
+//
+// Returns the hunks of a shortest edit script that turns a into b, using
+// Myers' greedy algorithm, or no hunks if a and b are the same. reached_end is
+// set to false if the script doesn't go all the way to the ends of a and b.
+//
+// v[k] is the furthest x reached on diagonal k = x - y with d edits, or -1 if
+// diagonal k can't be reached. From d - 1 edits, diagonal k is reached either
+// by inserting a line of b from diagonal k + 1 ("down"), or deleting a line of
+// a from diagonal k - 1 ("right"), followed by a "snake" of equal lines. Each
+// row of v is saved in trace so the path can be followed back from the end.
+// If the end isn't reached within max_edits edits, the path is followed back
+// from the point that got furthest instead.
+//
+vector<Hunk> edit_hunks(const vector<Line> &a, const vector<Line> &b, bool &reached_end)
+{
+    const int n = a.size();
+    const int m = b.size();
+    const int offset = max_edits + 1;
+    vector<int> v(2 * max_edits + 3, -1);
+    vector<int> trace; // row d is the d * d + d + k entry, for k from -d to d
+
+    // the x a step reaches diagonal k with, given the previous row of v
+    auto step = [&](int d, int k, const int *prev_k) -> int
+    {
+        int down = (k < d) ? prev_k[k + 1] : -1;
+        if (down - k > m)
+            down = -1;
+        int right = (k > -d && prev_k[k - 1] >= 0) ? prev_k[k - 1] + 1 : -1;
+        if (right > n)
+            right = -1;
+        return max(down, right);
+    };
+
+    int end_d = 0;
+    int end_k = 0;
+    int best_k = 0;
+    reached_end = false;
+    for (int d = 0; d <= max_edits; d++)
+    {
+        int best = -1;
+        for (int k = -d; k <= d; k += 2)
+        {
+            int x = (d == 0) ? 0 : step(d, k, &v[offset]);
+            if (x >= 0)
+            {
+                while (x < n && x - k < m && a[x] == b[x - k])
+                    x++;
+                if (2 * x - k > best)
+                {
+                    best = 2 * x - k;
+                    best_k = k;
+                }
+                if (x == n && x - k == m)
+                {
+                    reached_end = true;
+                    end_k = k;
+                }
+            }
+            v[offset + k] = x;
+        }
+        trace.insert(trace.end(), v.begin() + offset - d, v.begin() + offset + d + 1);
+        end_d = d;
+        if (reached_end)
+            break;
+        end_k = best_k;
+    }
+
+    // follow the path back to find where each edit starts and ends
+    struct Edit
+    {
+        int x0, y0; // before the edit
+        int x1, y1; // after the edit
+    };
+    vector<Edit> edits(end_d);
+    int k = end_k;
+    for (int d = end_d; d >= 1; d--)
+    {
+        const int *prev_k = &trace[(d - 1) * (d - 1) + (d - 1)];
+        int x = step(d, k, prev_k);
+        int prev = (x == prev_k[k + 1] && k < d) ? k + 1 : k - 1;
+        int prev_x = prev_k[prev];
+        edits[d - 1] = Edit{prev_x, prev_x - prev, x, x - k};
+        k = prev;
+    }
+
+    // a hunk is a run of edits with no equal lines in between
+    vector<Hunk> hunks;
+    for (const Edit &e : edits)
+    {
+        if (!hunks.empty() && e.x0 == hunks.back().a_end && e.y0 == hunks.back().b_end)
+        {
+            hunks.back().a_end = e.x1;
+            hunks.back().b_end = e.y1;
+        }
+        else
+        {
+            hunks.push_back(Hunk{e.x0, e.x1, e.y0, e.y1});
+        }
+    }
+    return hunks;
+} // edit_hunks
+
+// Prints a range of line numbers (counting from 1) the way diff does.
+void print_range(long long first, long long last)
+{
+    if (first < last)
+        cout << first << "," << last;
+    else
+        cout << last;
+}
+
+// Prints a hunk the way diff does. a_line_num and b_line_num are the number
+// of lines before the windows a and b.
+void print_hunk(const Hunk &h, const vector<Line> &a, const vector<Line> &b,
+                long long a_line_num, long long b_line_num)
+{
+    const char kind = (h.a_start == h.a_end) ? 'a' : (h.b_start == h.b_end) ? 'd' : 'c';
+    print_range(a_line_num + h.a_start + 1, a_line_num + h.a_end);
+    cout << kind;
+    print_range(b_line_num + h.b_start + 1, b_line_num + h.b_end);
+    cout << "\n";
+    for (int i = h.a_start; i < h.a_end; i++)
+    {
+        cout << "< " << a[i].text << "\n";
+    }
+    if (kind == 'c')
+        cout << "---\n";
+    for (int i = h.b_start; i < h.b_end; i++)
+    {
+        cout << "> " << b[i].text << "\n";
+    }
+}
+
+//
+// Prints the first max_hunks hunks of differences between a and b. Returns
+// the number printed, or max_hunks + 1 if there are more than that.
+//
+int line_diff(Input &a, Input &b, int max_hunks)
+{
+    int num_hunks = 0;
+    for (;;)
+    {
+        skip_same(a, b);
+        if (a.pos == a.end && b.pos == b.end)
+            return num_hunks;
+        if (num_hunks == max_hunks)
+            return max_hunks + 1;
+
+        const char *a_window_end;
+        const char *b_window_end;
+        vector<Line> a_lines = read_window(a, a_window_end);
+        vector<Line> b_lines = read_window(b, b_window_end);
+        bool reached_end;
+        vector<Hunk> hunks = edit_hunks(a_lines, b_lines, reached_end);
+        if (hunks.empty())
+        {
+            // the windows' lines are the same, so the files only differ in a
+            // missing '\n' at the end
+            a.advance(a_window_end - a.pos, a_lines.size());
+            b.advance(b_window_end - b.pos, b_lines.size());
+            continue;
+        }
+
+        // unless the script goes to the ends of both files, its last hunk may
+        // only be part of a hunk, so it's left for the next window
+        if (hunks.size() > 1 && !(reached_end && a_window_end == a.end && b_window_end == b.end))
+            hunks.pop_back();
+        if (int(hunks.size()) > max_hunks - num_hunks)
+            hunks.resize(max_hunks - num_hunks);
+        for (const Hunk &h : hunks)
+        {
+            print_hunk(h, a_lines, b_lines, a.line_num, b.line_num);
+        }
+        num_hunks += hunks.size();
+
+        const Hunk &h = hunks.back();
+        const char *a_next = (h.a_end < int(a_lines.size())) ? a_lines[h.a_end].text.data() : a_window_end;
+        const char *b_next = (h.b_end < int(b_lines.size())) ? b_lines[h.b_end].text.data() : b_window_end;
+        a.advance(a_next - a.pos, h.a_end);
+        b.advance(b_next - b.pos, h.b_end);
+    }
+} // line_diff
+
+void usage()
+{
+    cout << "Usage: ./line_diff [-n max_hunks] file1 file2\n";
+}
+
+int main(int argc, char *argv[])
+{
+    ios_base::sync_with_stdio(false);
+
+    int max_hunks = 10;
+    vector<string> fnames;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-n")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            if (value.empty() || value.size() > 9 ||
+                value.find_first_not_of("0123456789") != string::npos)
+            {
+                cout << "Error: invalid number of hunks \"" << value << "\"\n";
+                usage();
+                return 2;
+            }
+            max_hunks = stoi(value);
+        }
+        else
+        {
+            fnames.push_back(arg);
+        }
+    }
+    if (fnames.size() != 2)
+    {
+        usage();
+        return 2;
+    }
+
+    cmpt::Mapped_file file1(fnames[0]);
+    cmpt::Mapped_file file2(fnames[1]);
+    for (int i = 0; i < 2; i++)
+    {
+        if (!(i == 0 ? file1 : file2).is_open())
+        {
+            cout << "Error: unable to map file \"" << fnames[i] << "\"\n";
+            return 2;
+        }
+    }
+
+    Input a(file1);
+    Input b(file2);
+    int num_hunks = line_diff(a, b, max_hunks);
+    cout.flush();
+    if (num_hunks > max_hunks && max_hunks > 0)
+        cerr << "(stopped after " << max_hunks << " hunks; there are more differences)\n";
+    return num_hunks == 0 ? 0 : 1;
+}
@@ -22,11 +22,1439 @@
 //
 /////////////////////////////////////////////////////////////////////////
 
+//
+// Sorts the lines of a file, like the Linux sort command:
+//
+//   > ./mysort names.txt
+//   Beth
+//   Evil Morty
+//   ...
+//
+//   ./mysort filename [-r|-s] [--memory-limit size] [--storage strings|table|prefix]
+//                     [--engine std|mkqs] [-j num_threads] [--index] [--stats]
+//                     [--benchmark] [--index-benchmark]
+//     -r: sort in reverse order
+//     -s: sort in increasing order of string length
+//     --memory-limit: use an external merge sort that never holds more than
+//                     about size bytes of lines in memory, e.g. 500M or 2G
+//     --storage: how lines are stored in memory (see below); the default is
+//                strings
+//     --engine: the sorting algorithm to use (see below); the default is std
+//     -j: the number of threads to sort with (see below); the default is 1
+//     --index: save the sorted order in a file next to the input, and use it
+//              next time if the input hasn't changed (see below)
+//     --stats: print the time taken and the peak memory used to cerr
+//     --benchmark: time each engine on the file instead of printing it
+//     --index-benchmark: time sorting with --index when the index has to be
+//                        made, and when it can be used
+//
+// Lines are compared byte by byte, which is the same order as the Linux sort
+// command uses with LC_ALL=C. Each option changes one part of how the sort is
+// done, and the details are in the comments on the code that does it:
+//
+// - --memory-limit does an external merge sort: sorted runs that fit in the
+//   limit are written to a temporary directory and then merged (see
+//   sort_external).
+// - --storage table sorts a table of string_views into the memory-mapped file
+//   instead of a string per line (see Line_table), and --storage prefix also
+//   keeps each line's first 8 bytes in its entry (see Prefixed_line).
+// - --engine mkqs uses multikey quicksort, which looks at each character of a
+//   shared prefix only about once (see multikey_quicksort).
+// - -s puts the lines into buckets by length and sorts each bucket (see
+//   sort_by_length_buckets).
+// - -j uses a parallel merge sort (see parallel_sort).
+// - --index saves the sorted order next to the input and reuses it while the
+//   input doesn't change (see Sort_index).
+//
+
+#include "cmpt_mapped_file.h"
+#include "cmpt_size.h"
+#include "cmpt_temp_dir.h"
+#include "cmpt_tokenizer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-int main()
+enum class Order
+{
+    alphabetical, // default
+    reverse,      // -r
+    by_length     // -s
+};
+
+enum class Engine
+{
+    std_sort,          // std::sort
+    multikey_quicksort // mkqs
+};
+
+enum class Storage
+{
+    strings, // one string per line
+    table,   // a table of string_views into the file
+    prefix   // a table of Prefixed_lines
+};
+
+// The settings given on the command-line.
+struct Options
+{
+    Order order = Order::alphabetical;
+    Engine engine = Engine::std_sort;
+    int num_threads = 1;
+    long long memory_limit = 0; // 0 means sort in memory
+    Storage storage = Storage::strings;
+    bool use_index = false;
+    bool show_stats = false;
+    bool benchmark = false;
+    bool index_benchmark = false;
+};
+
+// Returns true if line a comes before line b in the given order. Lines can be
+// strings or string_views.
+struct Line_order
+{
+    Order order;
+
+    template <class Line>
+    bool operator()(const Line &a, const Line &b) const
+    {
+        switch (order)
+        {
+        case Order::alphabetical:
+            return a < b;
+        case Order::reverse:
+            return b < a;
+        case Order::by_length:
+            if (a.size() != b.size())
+                return a.size() < b.size();
+            return a < b;
+        }
+        return false;
+    }
+};
+
+void usage()
+{
+    cout << "Usage: ./mysort input_file.txt [-r|-s] [--memory-limit size]\n";
+    cout << "                [--storage strings|table|prefix] [--engine std|mkqs]\n";
+    cout << "                [-j num_threads] [--index] [--stats] [--benchmark]\n";
+    cout << "                [--index-benchmark]\n";
+    cout << "  -r: sort in reverse order\n";
+    cout << "  -s: sort in increasing order of string length\n";
+    cout << "  --memory-limit: sort using at most about size bytes of memory,\n";
+    cout << "                  e.g. 500M or 2G, with temporary files in $TMPDIR\n";
+    cout << "  --storage: store lines as separate strings (the default), as a\n";
+    cout << "             table of positions in the file, or as a table that also\n";
+    cout << "             holds the first 8 bytes of each line\n";
+    cout << "  --engine: sort with std::sort (the default), or multikey quicksort\n";
+    cout << "  -j: number of threads to sort with (default 1)\n";
+    cout << "  --index: save the sorted order next to the file, and re-use it\n";
+    cout << "           while the file doesn't change\n";
+    cout << "  --stats: print the time and peak memory used to cerr\n";
+    cout << "  --benchmark: time each engine on the file instead of sorting it\n";
+    cout << "  --index-benchmark: time --index with and without a saved index\n";
+}
+
+template <class Line>
+void print_lines(const vector<Line> &lines, ostream &out = cout)
+{
+    for (const Line &line : lines)
+    {
+        out << line << "\n";
+    }
+}
+
+// Returns the character at position d of line as a number from 0 to 255, or -1
+// if line has only d characters. -1 makes a line come before all the longer
+// lines that start with it.
+template <class Line>
+int char_at(const Line &line, size_t d)
+{
+    return d < line.size() ? static_cast<unsigned char>(line[d]) : -1;
+}
+
+//
+// Sorts the n lines starting at lines alphabetically, assuming they all have
+// the same first depth characters.
+//
+// std::sort compares whole lines, and lines that start with the same
+// characters (like "unbeliever" and "unbelievers" in ospd.txt) have those
+// characters compared again and again. Multikey quicksort (Bentley and
+// Sedgewick, "Fast Algorithms for Sorting and Searching Strings", 1997) is a
+// mix of quicksort and radix sort that looks at one character position at a
+// time:
+//
+//   1. Pick a pivot character c from position d of some line.
+//   2. Partition the lines into those whose character at position d is less
+//      than c, equal to c, and greater than c.
+//   3. Sort the "less" and "greater" parts the same way, still at position
+//      d, and sort the "equal" part at position d + 1.
+//
+// Each character of a shared prefix is only looked at about once per line.
+// --benchmark compares the engines on a file, e.g.:
+//
+//   > ./mysort ../../sample_code/week11/ospd_shuffled.txt --benchmark
+//   79339 lines
+//   std::sort default: 0.0771694s
+//   mkqs      default: 0.0458652s (same output)
+//   std::sort -r     : 0.0846389s
+//   mkqs      -r     : 0.0451524s (same output)
+//
+template <class Line>
+void multikey_quicksort(Line *lines, size_t n, size_t depth)
+{
+    while (n > 1)
+    {
+        // insertion sort is faster for just a few lines
+        if (n < 16)
+        {
+            for (size_t i = 1; i < n; i++)
+            {
+                for (size_t j = i; j > 0 && lines[j].compare(depth, Line::npos, lines[j - 1],
+                                                             depth, Line::npos) < 0;
+                     j--)
+                {
+                    swap(lines[j], lines[j - 1]);
+                }
+            }
+            return;
+        }
+
+        // the pivot is the median of the first, middle, and last characters
+        int a = char_at(lines[0], depth);
+        int b = char_at(lines[n / 2], depth);
+        int c = char_at(lines[n - 1], depth);
+        int pivot = max(min(a, b), min(max(a, b), c));
+
+        // 3-way partition: lines[0..lt) < pivot, lines[lt..gt) == pivot, and
+        // lines[gt..n) > pivot
+        size_t lt = 0;
+        size_t i = 0;
+        size_t gt = n;
+        while (i < gt)
+        {
+            int ch = char_at(lines[i], depth);
+            if (ch < pivot)
+                swap(lines[lt++], lines[i++]);
+            else if (ch > pivot)
+                swap(lines[i], lines[--gt]);
+            else
+                i++;
+        }
+
+        multikey_quicksort(lines, lt, depth);
+        multikey_quicksort(lines + gt, n - gt, depth);
+
+        // lines that ended at depth are all equal, so there's nothing left to
+        // sort; otherwise, loop to sort the equal part at the next position
+        if (pivot == -1)
+            return;
+        lines += lt;
+        n = gt - lt;
+        depth++;
+    }
+} // multikey_quicksort
+
+template <class Line>
+void sort_alphabetically(Line *first, Line *last, Engine engine)
+{
+    if (engine == Engine::multikey_quicksort)
+        multikey_quicksort(first, last - first, 0);
+    else
+        sort(first, last);
+}
+
+// Sorts the lines from first up to, but not including, last, in alphabetical
+// or reverse order on this thread.
+template <class Line>
+void sort_range(Line *first, Line *last, Order order, Engine engine)
+{
+    if (order == Order::reverse && engine == Engine::std_sort)
+    {
+        sort(first, last, greater<Line>());
+        return;
+    }
+
+    sort_alphabetically(first, last, engine);
+    if (order == Order::reverse)
+    {
+        // equal lines are identical, so reversing the sorted lines gives
+        // exactly the same result as sorting in reverse
+        reverse(first, last);
+    }
+}
+
+// Calls task(0), task(1), ..., task(num_tasks - 1) using num_threads threads.
+// Each thread, including this one, repeatedly does the next task not yet
+// started until there are none left.
+template <class Task>
+void run_in_parallel(int num_tasks, int num_threads, Task task)
+{
+    atomic<int> next_task(0);
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            int i = next_task++;
+            if (i >= num_tasks)
+                return;
+            task(i);
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < min(num_threads, num_tasks); t++)
+    {
+        workers.push_back(thread(worker));
+    }
+    worker();
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+}
+
+// Merging the lines a_first..a_last with b_first..b_last into out.
+template <class Line>
+struct Merge_task
+{
+    Line *a_first;
+    Line *a_last;
+    Line *b_first;
+    Line *b_last;
+    Line *out;
+};
+
+//
+// Adds tasks that together merge a_first..a_last with b_first..b_last into
+// out, split into num_pieces pieces that can be done at the same time.
+//
+// a is cut into num_pieces equal pieces. A piece of a that starts with line x
+// is merged with the part of b that starts at the first line of b that isn't
+// before x (found with binary search). Every line in the pieces before that
+// comes before x, and so all the pieces can be merged separately.
+//
+template <class Line>
+void add_merge_tasks(Line *a_first, Line *a_last, Line *b_first, Line *b_last, Line *out,
+                     Order order, int num_pieces, vector<Merge_task<Line>> &tasks)
+{
+    const size_t a_size = a_last - a_first;
+    Line *a_piece = a_first;
+    Line *b_piece = b_first;
+    for (int k = 1; k <= num_pieces; k++)
+    {
+        Line *a_next = a_first + a_size * k / num_pieces;
+        Line *b_next = b_last;
+        if (a_next != a_last)
+            b_next = lower_bound(b_piece, b_last, *a_next, Line_order{order});
+        tasks.push_back({a_piece, a_next, b_piece, b_next,
+                         out + (a_piece - a_first) + (b_piece - b_first)});
+        a_piece = a_next;
+        b_piece = b_next;
+    }
+}
+
+//
+// Parallel merge sort. The lines are cut into num_threads parts of the same
+// size, and each part is sorted on its own thread using engine. Then
+// neighbouring parts are merged in pairs, again using all the threads, until
+// there is only one part (see add_merge_tasks). Lines move back and forth
+// between the lines themselves and a buffer of the same size on each round of
+// merging. For -s, buckets bigger than 1/num_threads of the lines are sorted
+// this way.
+//
+// The result is always the same as sorting on one thread: any two lines that
+// are equal are identical, so it doesn't matter which one comes first.
+//
+template <class Line>
+void parallel_sort(Line *first, Line *last, Order order, Engine engine, int num_threads)
+{
+    // parts smaller than this aren't worth starting a thread for
+    const size_t min_part_size = 1 << 14;
+
+    const size_t n = last - first;
+    const int num_parts = min<size_t>(num_threads, n / min_part_size);
+    if (num_parts <= 1)
+    {
+        sort_range(first, last, order, engine);
+        return;
+    }
+
+    // part k is from offset[k] up to offset[k + 1]
+    vector<size_t> offset;
+    for (int k = 0; k <= num_parts; k++)
+    {
+        offset.push_back(n * k / num_parts);
+    }
+    run_in_parallel(num_parts, num_threads, [&](int k)
+                    { sort_range(first + offset[k], first + offset[k + 1], order, engine); });
+
+    vector<Line> buffer(n);
+    Line *from = first;
+    Line *to = buffer.data();
+    while (offset.size() > 2)
+    {
+        const int num_pairs = (offset.size() - 1) / 2;
+        const int pieces_per_pair = max(1, num_threads / num_pairs);
+
+        vector<Merge_task<Line>> tasks;
+        vector<size_t> merged_offset;
+        for (int k = 0; k + 1 < offset.size(); k += 2)
+        {
+            merged_offset.push_back(offset[k]);
+            if (k + 2 < offset.size())
+            {
+                add_merge_tasks(from + offset[k], from + offset[k + 1], from + offset[k + 1],
+                                from + offset[k + 2], to + offset[k], order, pieces_per_pair,
+                                tasks);
+            }
+            else
+            {
+                // an odd part out is merged with nothing, i.e. just moved
+                add_merge_tasks(from + offset[k], from + offset[k + 1], from + offset[k + 1],
+                                from + offset[k + 1], to + offset[k], order, 1, tasks);
+            }
+        }
+        merged_offset.push_back(n);
+
+        run_in_parallel(tasks.size(), num_threads, [&](int i)
+                        {
+                            const Merge_task<Line> &t = tasks[i];
+                            merge(make_move_iterator(t.a_first), make_move_iterator(t.a_last),
+                                  make_move_iterator(t.b_first), make_move_iterator(t.b_last),
+                                  t.out, Line_order{order}); });
+
+        offset = merged_offset;
+        swap(from, to);
+    }
+
+    if (from != first)
+        move(from, from + n, first);
+} // parallel_sort
+
+// The original way of doing -s: sort alphabetically, and then by length
+// keeping lines of the same length in alphabetical order.
+template <class Line>
+void sort_by_length_two_pass(vector<Line> &lines, Engine engine)
+{
+    sort_alphabetically(lines.data(), lines.data() + lines.size(), engine);
+    stable_sort(lines.begin(), lines.end(),
+                [](const Line &a, const Line &b)
+                { return a.size() < b.size(); });
+}
+
+//
+// Sorts lines by length, and lines of the same length alphabetically, by
+// putting them into buckets by length.
+//
+// The simplest way to do -s is to sort alphabetically, and then stable_sort by
+// length (sort_by_length_two_pass). But that's two full sorts, and the second
+// one doesn't need to compare anything but lengths. So instead, a counting
+// sort puts the lines into buckets, one for each line length, without
+// changing the order of the lines. Then each bucket is sorted alphabetically
+// on its own using engine. The buckets are independent, and so with -j they
+// are sorted at the same time on multiple threads, biggest bucket first. The
+// result is exactly the same as the two-sort way, which --benchmark checks.
+//
+// Lines of length max_bucket_length or more share one last bucket, which is
+// sorted by comparing lengths and then characters. That way a file with one
+// enormous line doesn't need an enormous number of buckets.
+//
+template <class Line>
+void sort_by_length_buckets(vector<Line> &lines, Engine engine, int num_threads)
+{
+    const size_t max_bucket_length = 1 << 16;
+
+    // counting sort: count the lines of each length, and then calculate where
+    // each bucket starts
+    vector<size_t> bucket_start(max_bucket_length + 2, 0);
+    for (const Line &line : lines)
+    {
+        bucket_start[min(line.size(), max_bucket_length) + 1]++;
+    }
+    for (size_t len = 1; len < bucket_start.size(); len++)
+    {
+        bucket_start[len] += bucket_start[len - 1];
+    }
+
+    // move each line into its bucket; bucket len will be from
+    // bucket_start[len] up to bucket_start[len + 1]
+    vector<size_t> next = bucket_start;
+    vector<Line> by_length(lines.size());
+    for (Line &line : lines)
+    {
+        by_length[next[min(line.size(), max_bucket_length)]++] = move(line);
+    }
+    lines.swap(by_length);
+
+    // A bucket with more than its share of the lines would keep one thread
+    // busy long after the others are done, so those buckets are sorted first
+    // with a parallel sort. The rest are sorted at the same time as each
+    // other, biggest first, so that the threads finish at about the same time.
+    const size_t big_bucket_size = lines.size() / num_threads + 1;
+    vector<size_t> buckets;
+    for (size_t len = 0; len < max_bucket_length; len++)
+    {
+        Line *first = lines.data() + bucket_start[len];
+        Line *last = lines.data() + bucket_start[len + 1];
+        if (num_threads > 1 && last - first > big_bucket_size)
+            parallel_sort(first, last, Order::alphabetical, engine, num_threads);
+        else if (last > first)
+            buckets.push_back(len);
+    }
+    sort(buckets.begin(), buckets.end(),
+         [&](size_t a, size_t b)
+         { return bucket_start[a + 1] - bucket_start[a] > bucket_start[b + 1] - bucket_start[b]; });
+
+    run_in_parallel(buckets.size(), num_threads, [&](int b)
+                    {
+                        size_t len = buckets[b];
+                        sort_alphabetically(lines.data() + bucket_start[len],
+                                            lines.data() + bucket_start[len + 1], engine); });
+
+    // the last bucket, of the longest lines
+    sort(lines.data() + bucket_start[max_bucket_length],
+         lines.data() + bucket_start[max_bucket_length + 1], Line_order{Order::by_length});
+} // sort_by_length_buckets
+
+// Sort lines in the given order using num_threads threads. Lines can be
+// strings or string_views.
+template <class Line>
+void sort_lines(vector<Line> &lines, Order order, Engine engine, int num_threads = 1)
+{
+    Line *first = lines.data();
+    Line *last = lines.data() + lines.size();
+    if (order == Order::by_length)
+        sort_by_length_buckets(lines, engine, num_threads);
+    else if (num_threads > 1)
+        parallel_sort(first, last, order, engine, num_threads);
+    else
+        sort_range(first, last, order, engine);
+}
+
+void sort_in_memory(const string &fname, const Options &opt)
+{
+    cmpt::Tokenizer infile(fname, cmpt::Tokenizer::lines, false);
+    vector<string> lines;
+    string_view line;
+    while (infile.next(line))
+    {
+        lines.push_back(string(line));
+    }
+    sort_lines(lines, opt.order, opt.engine, opt.num_threads);
+    print_lines(lines);
+}
+
+//
+// Returns a table of the lines from begin to end. Lines are split the same way
+// as getline does: a '\n' ends a line, and the last line doesn't need a '\n'.
+//
+vector<string_view> split_lines(const char *begin, const char *end)
+{
+    cmpt::Tokenizer in(begin, end, cmpt::Tokenizer::lines);
+    vector<string_view> lines;
+    string_view line;
+    while (in.next(line))
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+//
+// The lines of a file stored as a table of string_views, for --storage table.
+// The file's mapped memory is used if possible, and otherwise the file is read
+// into one string.
+//
+// Normally each line is copied into its own string, and so a file with
+// millions of short lines needs millions of small memory allocations. A
+// string_view is just a pointer to the start of a line in the file and its
+// length, so no lines are copied and no memory is allocated per line. For
+// example, on tiny_shakespeare.txt repeated 20 times (22 MB, 800,000 lines):
+//
+//   > ./mysort big.txt --storage strings --stats > /dev/null
+//   time: 1.55552s, peak memory: 54.9023 MB
+//
+//   > ./mysort big.txt --storage table --stats > /dev/null
+//   time: 1.79183s, peak memory: 36.7383 MB
+//
+// So the table uses about a third less memory. It isn't faster when compiled
+// with the makefile, but compiled with -O2 it takes 0.73s versus 1.06s. One
+// cost of the table is that comparing two lines means following pointers to
+// two different places in the file, while a short string (up to 15
+// characters) is stored right inside the string object. Prefixed_line fixes
+// that.
+//
+class Line_table
+{
+    cmpt::Mapped_file file;
+    string contents;
+
+public:
+    vector<string_view> lines;
+
+    Line_table(const string &fname, ifstream &infile)
+        : file(fname)
+    {
+        if (file.is_open())
+        {
+            lines = split_lines(file.begin(), file.end());
+        }
+        else
+        {
+            contents.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+            lines = split_lines(contents.data(), contents.data() + contents.size());
+        }
+    }
+}; // class Line_table
+
+//
+// A line in the file, plus its first 8 bytes as a big-endian 64-bit number so
+// that most comparisons don't need to look at the line itself, for --storage
+// prefix. It has the same methods as string_view that the sorting functions
+// use.
+//
+// The first byte is in the highest 8 bits of the prefix, with 0s after the end
+// of short lines, so comparing two prefixes gives the same answer as comparing
+// the first 8 characters of the lines. Two lines only need to be compared
+// character by character when their first 8 bytes are the same. The length of
+// the line is also kept, so -s never needs to look at the line to find it.
+// --benchmark reports how often a full compare is needed, e.g. for
+// tiny_shakespeare.txt about 20% of comparisons need the full lines, and for
+// ospd_shuffled.txt, where no word is longer than 8 letters, none do.
+//
+class Prefixed_line
 {
-    cout << "mysort.cpp !" << endl;
+    uint64_t prefix = 0;
+    string_view line;
+
+public:
+    // How many times operator< has been called, and how many times it had to
+    // compare the full lines, on this thread.
+    inline static thread_local long long num_comparisons = 0;
+    inline static thread_local long long num_full_compares = 0;
+
+    static constexpr size_t npos = string_view::npos;
+
+    Prefixed_line() {}
+
+    Prefixed_line(string_view line)
+        : line(line)
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            unsigned char c = i < line.size() ? line[i] : 0;
+            prefix = (prefix << 8) | c;
+        }
+    }
+
+    string_view view() const { return line; }
+    size_t size() const { return line.size(); }
+    char operator[](size_t i) const { return line[i]; }
+
+    int compare(size_t pos1, size_t count1, const Prefixed_line &other, size_t pos2,
+                size_t count2) const
+    {
+        return line.compare(pos1, count1, other.line, pos2, count2);
+    }
+
+    bool operator<(const Prefixed_line &other) const
+    {
+        num_comparisons++;
+        if (prefix != other.prefix)
+            return prefix < other.prefix;
+        num_full_compares++;
+        return line < other.line;
+    }
+
+    bool operator>(const Prefixed_line &other) const { return other < *this; }
+}; // class Prefixed_line
+
+ostream &operator<<(ostream &out, const Prefixed_line &line)
+{
+    return out << line.view();
 }
+
+vector<Prefixed_line> add_prefixes(const vector<string_view> &lines)
+{
+    return vector<Prefixed_line>(lines.begin(), lines.end());
+}
+
+// Returns the string_views in lines.
+vector<string_view> views(const vector<Prefixed_line> &lines)
+{
+    vector<string_view> result;
+    for (const Prefixed_line &line : lines)
+    {
+        result.push_back(line.view());
+    }
+    return result;
+}
+
+void sort_line_table(const string &fname, ifstream &infile, const Options &opt)
+{
+    Line_table table(fname, infile);
+    if (opt.storage == Storage::prefix)
+    {
+        vector<Prefixed_line> lines = add_prefixes(table.lines);
+        sort_lines(lines, opt.order, opt.engine, opt.num_threads);
+        print_lines(lines);
+    }
+    else
+    {
+        sort_lines(table.lines, opt.order, opt.engine, opt.num_threads);
+        print_lines(table.lines);
+    }
+}
+
+//
+// Times sorting the lines of the file with each engine in each order, on one
+// thread and then (if -j is given) on num_threads threads. Every result is
+// checked against std::sort on one thread, or, for -s, against the two-sort
+// way of sorting by length.
+//
+// Then std::sort with --storage prefix is timed for each order on one thread,
+// and the percentage of its comparisons that needed the full lines is printed.
+//
+void benchmark(const string &fname, ifstream &infile, int num_threads)
+{
+    Line_table table(fname, infile);
+    cout << table.lines.size() << " lines\n";
+
+    const vector<Engine> engines = {Engine::std_sort, Engine::multikey_quicksort};
+    const vector<string> engine_names = {"std::sort", "mkqs     "};
+    const vector<Order> orders = {Order::alphabetical, Order::reverse, Order::by_length};
+    const vector<string> order_names = {"default", "-r     ", "-s     "};
+    vector<int> thread_counts = {1};
+    if (num_threads > 1)
+        thread_counts.push_back(num_threads);
+
+    for (int o = 0; o < orders.size(); o++)
+    {
+        vector<string_view> expected = table.lines;
+        auto start = chrono::steady_clock::now();
+        if (orders[o] == Order::by_length)
+            sort_by_length_two_pass(expected, Engine::std_sort);
+        else
+            sort_range(expected.data(), expected.data() + expected.size(), orders[o],
+                       Engine::std_sort);
+        auto end = chrono::steady_clock::now();
+        cout << (orders[o] == Order::by_length ? "two-pass " : "reference") << " "
+             << order_names[o] << "     : " << chrono::duration<double>(end - start).count()
+             << "s\n";
+
+        for (int e = 0; e < engines.size(); e++)
+        {
+            for (int threads : thread_counts)
+            {
+                vector<string_view> lines = table.lines;
+                start = chrono::steady_clock::now();
+                sort_lines(lines, orders[o], engines[e], threads);
+                end = chrono::steady_clock::now();
+
+                cout << engine_names[e] << " " << order_names[o] << " -j " << threads << ": "
+                     << chrono::duration<double>(end - start).count() << "s"
+                     << (lines == expected ? " (same output)" : " (DIFFERENT OUTPUT)") << "\n";
+            }
+        }
+
+        vector<Prefixed_line> lines = add_prefixes(table.lines);
+        Prefixed_line::num_comparisons = 0;
+        Prefixed_line::num_full_compares = 0;
+        start = chrono::steady_clock::now();
+        sort_lines(lines, orders[o], Engine::std_sort);
+        end = chrono::steady_clock::now();
+
+        cout << "prefix    " << order_names[o] << " -j 1: "
+             << chrono::duration<double>(end - start).count() << "s"
+             << (views(lines) == expected ? " (same output)" : " (DIFFERENT OUTPUT)") << ", "
+             << Prefixed_line::num_full_compares << " of " << Prefixed_line::num_comparisons
+             << " comparisons ("
+             << 100.0 * Prefixed_line::num_full_compares / max(1LL, Prefixed_line::num_comparisons)
+             << "%) were full compares\n";
+    }
+} // benchmark
+
+//
+// The sidecar index for a file, used by --index.
+//
+// Sorting the same big file again and again does the same work every time.
+// With --index, mysort keeps a *sidecar* file next to the input, named like
+// the input with .mysort-index added. It holds the input's size, modification
+// time and a 64-bit hash of its contents, plus, for each of the default, -r
+// and -s orders that has been used, the sorted order of the lines as a list of
+// line numbers (a permutation). If the input's size, modification time and
+// hash all match, the lines are just printed in the saved order, and no
+// sorting is done; otherwise the old index is thrown away. If the order
+// hasn't been saved yet, the lines are sorted (using --engine and -j) and the
+// order is added to the index.
+//
+// Checking the hash means reading the whole file, but that's much faster than
+// sorting it. --index-benchmark times a cold run (no index) against a warm run
+// (index already made) for each order, e.g. on tiny_shakespeare.txt repeated 20
+// times:
+//
+//   > ./mysort big.txt --index-benchmark
+//   default: cold 1.96639s, warm 0.284509s (same output)
+//   -r     : cold 2.08492s, warm 0.400798s (same output)
+//   -s     : cold 1.78694s, warm 0.366058s (same output)
+//
+// The index uses this computer's byte order, and only works for files with
+// fewer than 2^32 lines.
+//
+struct Sort_index
+{
+    // what the file was like when the index was made
+    uint64_t file_size = 0;
+    int64_t mtime_sec = 0;
+    int64_t mtime_nsec = 0;
+    uint64_t hash = 0;
+    uint64_t num_lines = 0;
+
+    // permutations[o] is the sorted order of the lines for the Order whose
+    // value is o, if has_permutation[o] is true
+    static const int num_orders = 3;
+    bool has_permutation[num_orders] = {false, false, false};
+    vector<uint32_t> permutations[num_orders];
+};
+
+const char index_magic[8] = {'M', 'Y', 'S', 'O', 'R', 'T', 'I', 'X'};
+const uint64_t index_version = 1;
+
+string index_fname(const string &fname)
+{
+    return fname + ".mysort-index";
+}
+
+//
+// A fast 64-bit hash of the characters from begin to end, 8 bytes at a time.
+// It isn't cryptographic, but any ordinary change to a file changes it.
+//
+uint64_t hash_contents(const char *begin, const char *end)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15;
+    uint64_t h = end - begin;
+    const char *p = begin;
+    for (; end - p >= 8; p += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (((h << 5) | (h >> 59)) ^ word) * k;
+    }
+    uint64_t last = 0;
+    memcpy(&last, p, end - p);
+    h = (((h << 5) | (h >> 59)) ^ last) * k;
+    h ^= h >> 32;
+    return h;
+}
+
+//
+// Reads the index in fname into index, if it is an index for the file described
+// by current. Returns false if there's no index, it isn't a valid index, or it
+// is for a different version of the file. The header is checked against current
+// and the size of fname before any memory is allocated for the permutations,
+// so a damaged or hostile index can't make mysort allocate more than the file
+// it's indexing needs.
+//
+bool read_index(const string &fname, const Sort_index &current, Sort_index &index)
+{
+    ifstream in(fname, ios::binary | ios::ate);
+    if (!in)
+        return false;
+    const uint64_t index_size = in.tellg();
+    in.seekg(0);
+
+    char magic[8];
+    uint64_t version = 0;
+    uint64_t mask = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    if (!in || memcmp(magic, index_magic, sizeof(magic)) != 0 || version != index_version)
+        return false;
+    in.read(reinterpret_cast<char *>(&index.file_size), sizeof(index.file_size));
+    in.read(reinterpret_cast<char *>(&index.mtime_sec), sizeof(index.mtime_sec));
+    in.read(reinterpret_cast<char *>(&index.mtime_nsec), sizeof(index.mtime_nsec));
+    in.read(reinterpret_cast<char *>(&index.hash), sizeof(index.hash));
+    in.read(reinterpret_cast<char *>(&index.num_lines), sizeof(index.num_lines));
+    in.read(reinterpret_cast<char *>(&mask), sizeof(mask));
+    if (!in || index.file_size != current.file_size || index.mtime_sec != current.mtime_sec ||
+        index.mtime_nsec != current.mtime_nsec || index.hash != current.hash ||
+        index.num_lines != current.num_lines || mask >> Sort_index::num_orders != 0)
+        return false;
+
+    // the rest of the index must be exactly the permutations named in mask
+    uint64_t num_permutations = 0;
+    for (int o = 0; o < Sort_index::num_orders; o++)
+    {
+        num_permutations += (mask >> o) & 1;
+    }
+    const uint64_t header_size = sizeof(magic) + 7 * sizeof(uint64_t);
+    if (index_size != header_size + num_permutations * index.num_lines * sizeof(uint32_t))
+        return false;
+
+    for (int o = 0; o < Sort_index::num_orders; o++)
+    {
+        index.has_permutation[o] = (mask >> o) & 1;
+        if (!index.has_permutation[o])
+            continue;
+        vector<uint32_t> &perm = index.permutations[o];
+        perm.resize(index.num_lines);
+        in.read(reinterpret_cast<char *>(perm.data()), perm.size() * sizeof(uint32_t));
+        if (!in)
+            return false;
+        for (uint32_t i : perm)
+        {
+            if (i >= index.num_lines)
+                return false;
+        }
+    }
+    return true;
+}
+
+//
+// Writes index to fname. It's written to a temporary file first, which is
+// then renamed, so fname is never left half-written. The temporary file gets a
+// unique name from mkstemp in the same directory (so the rename can't cross
+// file systems), so two mysorts writing the same index never share it.
+// Returns false if it couldn't be written.
+//
+bool write_index(const string &fname, const Sort_index &index)
+{
+    string temp_fname = fname + ".XXXXXX";
+    int fd = mkstemp(temp_fname.data());
+    if (fd == -1)
+        return false;
+    // mkstemp makes the file readable only by its owner; give it the
+    // permissions an ordinary new file would get instead
+    const mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+    close(fd);
+    {
+        ofstream out(temp_fname, ios::binary);
+        uint64_t mask = 0;
+        for (int o = 0; o < Sort_index::num_orders; o++)
+        {
+            if (index.has_permutation[o])
+                mask |= uint64_t(1) << o;
+        }
+        out.write(index_magic, sizeof(index_magic));
+        out.write(reinterpret_cast<const char *>(&index_version), sizeof(index_version));
+        out.write(reinterpret_cast<const char *>(&index.file_size), sizeof(index.file_size));
+        out.write(reinterpret_cast<const char *>(&index.mtime_sec), sizeof(index.mtime_sec));
+        out.write(reinterpret_cast<const char *>(&index.mtime_nsec), sizeof(index.mtime_nsec));
+        out.write(reinterpret_cast<const char *>(&index.hash), sizeof(index.hash));
+        out.write(reinterpret_cast<const char *>(&index.num_lines), sizeof(index.num_lines));
+        out.write(reinterpret_cast<const char *>(&mask), sizeof(mask));
+        for (int o = 0; o < Sort_index::num_orders; o++)
+        {
+            const vector<uint32_t> &perm = index.permutations[o];
+            if (index.has_permutation[o])
+                out.write(reinterpret_cast<const char *>(perm.data()), perm.size() * sizeof(uint32_t));
+        }
+        out.close();
+        if (!out)
+        {
+            remove(temp_fname.c_str());
+            return false;
+        }
+    }
+    return rename(temp_fname.c_str(), fname.c_str()) == 0;
+}
+
+//
+// Sorts the lines of fname using its sidecar index, and writes them to out.
+// The index is made, or brought up to date, if it needs to be (see
+// Sort_index). If the index can't be written, the sort still works.
+//
+void sort_with_index(const string &fname, const Options &opt, ostream &out)
+{
+    cmpt::Mapped_file file(fname);
+    struct stat info;
+    if (!file.is_open() || stat(fname.c_str(), &info) != 0)
+        throw runtime_error("--index only works with regular files");
+    vector<string_view> lines = split_lines(file.begin(), file.end());
+    if (lines.size() > UINT32_MAX)
+        throw runtime_error("too many lines to use --index");
+
+    Sort_index current;
+    current.file_size = file.size();
+    current.mtime_sec = info.st_mtim.tv_sec;
+    current.mtime_nsec = info.st_mtim.tv_nsec;
+    current.hash = hash_contents(file.begin(), file.end());
+    current.num_lines = lines.size();
+
+    // use the saved index only if it is for exactly this file
+    Sort_index index;
+    const string ifname = index_fname(fname);
+    if (!read_index(ifname, current, index))
+    {
+        index = current;
+    }
+
+    const int o = static_cast<int>(opt.order);
+    vector<uint32_t> &perm = index.permutations[o];
+    if (!index.has_permutation[o])
+    {
+        vector<string_view> sorted = lines;
+        sort_lines(sorted, opt.order, opt.engine, opt.num_threads);
+
+        // the lines in the file are in order of where they start, so a line's
+        // number can be found from its start with binary search
+        perm.resize(sorted.size());
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            auto it = lower_bound(lines.begin(), lines.end(), sorted[i].data(),
+                                  [](string_view line, const char *p)
+                                  { return line.data() < p; });
+            perm[i] = it - lines.begin();
+        }
+        index.has_permutation[o] = true;
+        if (!write_index(ifname, index))
+            cerr << "Warning: unable to write index file \"" << ifname << "\"\n";
+    }
+
+    for (uint32_t i : perm)
+    {
+        out << lines[i] << "\n";
+    }
+} // sort_with_index
+
+//
+// For each order, removes the index for fname and times sorting with
+// --index (a cold run, which has to make the index), and then times it again
+// (a warm run, which uses the index). The output of both runs is kept in
+// memory and compared.
+//
+void index_benchmark(const string &fname, const Options &opt)
+{
+    const vector<Order> orders = {Order::alphabetical, Order::reverse, Order::by_length};
+    const vector<string> order_names = {"default", "-r     ", "-s     "};
+    for (int o = 0; o < orders.size(); o++)
+    {
+        Options order_opt = opt;
+        order_opt.order = orders[o];
+        remove(index_fname(fname).c_str());
+
+        ostringstream cold_out;
+        auto start = chrono::steady_clock::now();
+        sort_with_index(fname, order_opt, cold_out);
+        auto end = chrono::steady_clock::now();
+        double cold = chrono::duration<double>(end - start).count();
+
+        ostringstream warm_out;
+        start = chrono::steady_clock::now();
+        sort_with_index(fname, order_opt, warm_out);
+        end = chrono::steady_clock::now();
+        double warm = chrono::duration<double>(end - start).count();
+
+        cout << order_names[o] << ": cold " << cold << "s, warm " << warm << "s"
+             << (cold_out.str() == warm_out.str() ? " (same output)" : " (DIFFERENT OUTPUT)")
+             << "\n";
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// External merge sort
+//
+// With --memory-limit, the file is read in pieces that fit in memory. Each
+// piece is sorted and written to its own temporary file, called a *run*, in a
+// new directory under $TMPDIR (or /tmp). The sorted runs are then merged
+// together (see merge_runs). If there are too many runs to open at once,
+// groups of them are first merged into bigger runs. The output is the same as
+// sorting in memory.
+//
+// The memory limit covers what a run uses at its peak (see
+// run_memory_after_adding), and a run is written out before adding a line
+// would go over the limit. On top of that, mysort uses a few MB that don't
+// depend on the size of the file, for file buffers and the tables -s uses, so
+// the peak memory reported by --stats is the limit plus about that much.
+//
+// The temporary directory is removed when mysort is done, and also if it's
+// killed by Ctrl-C, by kill, or by writing to a closed pipe, as in
+// ./mysort big.txt --memory-limit 1G | head (see cmpt_temp_dir.h).
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// The memory a string of n characters takes besides the string object itself.
+// Short strings are stored inside the string object (up to 15 characters with
+// g++), and longer ones in a block from new, which malloc rounds up to a
+// multiple of 16 bytes after adding 8 bytes of its own, with at least 32.
+long long heap_bytes(size_t n)
+{
+    static const size_t inside = string().capacity();
+    if (n <= inside)
+        return 0;
+    return max<long long>(32, (n + 1 + 8 + 15) / 16 * 16);
+}
+
+//
+// The memory a run would use at its peak if one more line of n characters was
+// added to lines, whose text takes text_bytes on the heap. That's the text,
+// plus the vector's array of string objects (its whole capacity, not just the
+// lines in it), plus:
+//
+// - while push_back grows the vector, both the old array and the new one that
+//   is twice as big, and
+// - while sorting, the second array that -j and -s move the lines into.
+//
+long long run_memory_after_adding(const vector<string> &lines, long long text_bytes, size_t n,
+                                  const Options &opt)
+{
+    const long long slot = sizeof(string);
+    long long capacity = lines.capacity();
+    long long growing = 0;
+    if (lines.size() == lines.capacity())
+    {
+        growing = capacity;
+        capacity = max(1LL, 2 * capacity);
+    }
+    long long sorting = 0;
+    if (opt.num_threads > 1 || opt.order == Order::by_length)
+        sorting = lines.size() + 1;
+
+    return text_bytes + heap_bytes(n) + (capacity + max(growing, sorting)) * slot;
+}
+
+// Temporary files for runs, all in one temporary directory that is deleted,
+// along with any runs still in it, when the Run_dir is destroyed or the
+// program is killed by a signal (see cmpt_temp_dir.h).
+class Run_dir
+{
+    cmpt::Temp_dir dir{"mysort"};
+    int num_created = 0;
+
+public:
+    // Returns the name of a new run file.
+    string new_run()
+    {
+        num_created++;
+        return dir.file("run" + to_string(num_created) + ".txt");
+    }
+}; // class Run_dir
+
+// Write lines to a new run file, and return its name.
+string write_run(const vector<string> &lines, Run_dir &runs)
+{
+    string fname = runs.new_run();
+    ofstream out(fname);
+    for (const string &line : lines)
+    {
+        out << line << "\n";
+    }
+    if (!out)
+        throw runtime_error("unable to write temporary file " + fname);
+    return fname;
+}
+
+//
+// Merge the sorted run files in run_fnames and write the result to out. The
+// heap holds one entry for each run that still has lines, and the entry with
+// the line that comes first is always at the top.
+//
+void merge_runs(const vector<string> &run_fnames, Order order, ostream &out)
+{
+    struct Entry
+    {
+        string line;
+        int run;
+    };
+
+    // priority_queue puts the *largest* element on top, so the comparison is
+    // reversed to get the smallest
+    Line_order before{order};
+    auto after = [&](const Entry &a, const Entry &b)
+    { return before(b.line, a.line); };
+    priority_queue<Entry, vector<Entry>, decltype(after)> heap(after);
+
+    vector<ifstream> inputs(run_fnames.size());
+    for (int i = 0; i < run_fnames.size(); i++)
+    {
+        inputs[i].open(run_fnames[i]);
+        if (!inputs[i])
+            throw runtime_error("unable to read temporary file " + run_fnames[i]);
+        Entry e{"", i};
+        if (getline(inputs[i], e.line))
+            heap.push(e);
+    }
+
+    // stop as soon as writing fails, e.g. when the disk is full; the caller
+    // checks out for that
+    while (!heap.empty() && out)
+    {
+        Entry e = heap.top();
+        heap.pop();
+        out << e.line << "\n";
+        if (getline(inputs[e.run], e.line))
+            heap.push(e);
+    }
+    for (int i = 0; i < run_fnames.size(); i++)
+    {
+        if (inputs[i].bad())
+            throw runtime_error("unable to read temporary file " + run_fnames[i]);
+    }
+}
+
+void sort_external(const string &fname, const Options &opt)
+{
+    // the most runs that are merged at once, to stay well under the limit on
+    // the number of open files
+    const int max_merge_width = 128;
+
+    Run_dir runs;
+    vector<string> run_fnames;
+
+    // write sorted runs that each fit in memory_limit
+    // the file is read in blocks rather than mapped, so that the pages that
+    // have been read don't count against the memory limit
+    cmpt::Tokenizer infile(fname, cmpt::Tokenizer::lines, false);
+    vector<string> lines;
+    long long text_bytes = 0;
+    string_view line;
+    while (infile.next(line))
+    {
+        if (!lines.empty() &&
+            run_memory_after_adding(lines, text_bytes, line.size(), opt) > opt.memory_limit)
+        {
+            sort_lines(lines, opt.order, opt.engine, opt.num_threads);
+            run_fnames.push_back(write_run(lines, runs));
+            // clear keeps the vector's capacity, so the next run re-uses it
+            lines.clear();
+            text_bytes = 0;
+        }
+        lines.push_back(string(line));
+        text_bytes += heap_bytes(line.size());
+    }
+
+    // if it all fits in memory, there's no need for any runs
+    if (run_fnames.empty())
+    {
+        sort_lines(lines, opt.order, opt.engine, opt.num_threads);
+        print_lines(lines);
+        return;
+    }
+    if (!lines.empty())
+    {
+        sort_lines(lines, opt.order, opt.engine, opt.num_threads);
+        run_fnames.push_back(write_run(lines, runs));
+    }
+    lines.clear();
+    lines.shrink_to_fit();
+
+    // merge groups of runs until there are few enough to merge in one go
+    while (run_fnames.size() > max_merge_width)
+    {
+        vector<string> merged_fnames;
+        for (int i = 0; i < run_fnames.size(); i += max_merge_width)
+        {
+            int group_end = min<int>(i + max_merge_width, run_fnames.size());
+            vector<string> group(run_fnames.begin() + i, run_fnames.begin() + group_end);
+            string fname = runs.new_run();
+            ofstream out(fname);
+            merge_runs(group, opt.order, out);
+            if (!out)
+                throw runtime_error("unable to write temporary file " + fname);
+            for (const string &f : group)
+            {
+                remove(f.c_str());
+            }
+            merged_fnames.push_back(fname);
+        }
+        run_fnames = merged_fnames;
+    }
+
+    merge_runs(run_fnames, opt.order, cout);
+    if (!cout)
+        throw runtime_error("unable to write the sorted lines");
+} // sort_external
+
+// Converts s to a number of threads from 1 to 1024. Returns 0 if s isn't a
+// valid number of threads.
+int parse_num_threads(const string &s)
+{
+    if (s.empty() || s.size() > 4 || s.find_first_not_of("0123456789") != string::npos)
+        return 0;
+    int n = stoi(s);
+    return n <= 1024 ? n : 0;
+}
+
+// Print the time since start and the peak memory used so far to cerr.
+void print_stats(chrono::steady_clock::time_point start)
+{
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double peak_mb = usage.ru_maxrss / 1024.0; // ru_maxrss is in KB on Linux
+    cerr << "time: " << seconds << "s, peak memory: " << peak_mb << " MB\n";
+}
+
+int main(int argc, char *argv[])
+{
+    auto start = chrono::steady_clock::now();
+
+    // separate the --options from the filename and the -r/-s option
+    Options opt;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--memory-limit")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            opt.memory_limit = cmpt::parse_size(value);
+            if (opt.memory_limit == 0)
+            {
+                cout << "Error: invalid memory limit \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--storage")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            if (value == "strings")
+                opt.storage = Storage::strings;
+            else if (value == "table")
+                opt.storage = Storage::table;
+            else if (value == "prefix")
+                opt.storage = Storage::prefix;
+            else
+            {
+                cout << "Error: unknown storage \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--engine")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            if (value != "std" && value != "mkqs")
+            {
+                cout << "Error: unknown engine \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+            opt.engine = (value == "std") ? Engine::std_sort : Engine::multikey_quicksort;
+        }
+        else if (arg == "-j")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            opt.num_threads = parse_num_threads(value);
+            if (opt.num_threads == 0)
+            {
+                cout << "Error: invalid number of threads \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+        }
+        else if (arg == "--stats")
+        {
+            opt.show_stats = true;
+        }
+        else if (arg == "--benchmark")
+        {
+            opt.benchmark = true;
+        }
+        else if (arg == "--index")
+        {
+            opt.use_index = true;
+        }
+        else if (arg == "--index-benchmark")
+        {
+            opt.index_benchmark = true;
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() < 1 || args.size() > 2)
+    {
+        cout << "Error: invalid number of arguments\n";
+        usage();
+        return 1;
+    }
+
+    if (args.size() == 2)
+    {
+        if (args[1] == "-r")
+        {
+            opt.order = Order::reverse;
+        }
+        else if (args[1] == "-s")
+        {
+            opt.order = Order::by_length;
+        }
+        else
+        {
+            cout << "Error: unknown option \"" << args[1] << "\"\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (opt.use_index && opt.memory_limit > 0)
+    {
+        cout << "Error: --index can't be used with --memory-limit\n";
+        usage();
+        return 1;
+    }
+
+    ifstream infile(args[0]);
+    if (infile.fail())
+    {
+        cout << "Error: unable to open file \"" << args[0] << "\"\n";
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        if (opt.benchmark)
+            benchmark(args[0], infile, opt.num_threads);
+        else if (opt.index_benchmark)
+            index_benchmark(args[0], opt);
+        else if (opt.use_index)
+            sort_with_index(args[0], opt, cout);
+        else if (opt.memory_limit > 0)
+            sort_external(args[0], opt);
+        else if (opt.storage != Storage::strings)
+            sort_line_table(args[0], infile, opt);
+        else
+            sort_in_memory(args[0], opt);
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (opt.show_stats)
+        print_stats(start);
+} // main
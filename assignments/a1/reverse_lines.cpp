@@ -0,0 +1,311 @@
+// reverse_lines.cpp
+
+//
+// Prints the lines of a file in reverse order, last line first, like the Linux
+// tac command. For example, reversing a sorted file gives the reverse-sorted
+// file:
+//
+//   > ./reverse_lines tiny_shakespeare_sorted.txt > reversed.txt
+//   > cmp reversed.txt tiny_shakespeare_reversed.txt
+//
+// With no file name, it reverses cin.
+//
+// The file is memory-mapped (see cmpt_mapped_file.h) and scanned from the end
+// backwards for '\n' characters, 32 (AVX2) or 16 (SSE2) characters at a time.
+// Each line is copied straight from the mapped file into a 1 MB output buffer,
+// so the lines are never stored anywhere else and files bigger than RAM work
+// fine: the operating system is told to read ahead *before* the part being
+// scanned, and to drop the pages that have already been written out.
+//
+// Standard input that isn't a regular file, e.g. a pipe, is first copied to a
+// temporary file in $TMPDIR (or /tmp) so it can be mapped.
+//
+// Every output line ends with a '\n', including the input's last line if it
+// didn't have one. So reversing "a\nb" prints "b\na\n".
+//
+
+#include "cmpt_mapped_file.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REVERSE_X86_SIMD
+#endif
+
+using namespace std;
+
+// Returns a pointer to the last '\n' from begin up to, but not including, end,
+// or nullptr if there isn't one. This is the scalar reference.
+const char *find_last_newline_scalar(const char *begin, const char *end)
+{
+    for (const char *p = end; p != begin; p--)
+    {
+        if (p[-1] == '\n')
+            return p - 1;
+    }
+    return nullptr;
+}
+
+#ifdef REVERSE_X86_SIMD
+//
+// The SIMD versions compare a block of characters ending at p with '\n' all at
+// once, and turn the comparison into a bit mask with one bit per character.
+// The highest 1 bit is the last '\n' in the block, and 31 minus the number of
+// leading 0 bits (__builtin_clz) is its position.
+//
+const char *find_last_newline_sse2(const char *begin, const char *end)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char *p = end;
+    for (; p - begin >= 16; p -= 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p - 16));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (mask != 0)
+            return p - 16 + (31 - __builtin_clz(mask));
+    }
+    return find_last_newline_scalar(begin, p);
+}
+
+__attribute__((target("avx2"))) const char *find_last_newline_avx2(const char *begin, const char *end)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const char *p = end;
+    for (; p - begin >= 32; p -= 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p - 32));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        if (mask != 0)
+            return p - 32 + (31 - __builtin_clz(mask));
+    }
+    return find_last_newline_scalar(begin, p);
+}
+#endif
+
+// Returns a pointer to the last '\n' from begin to end, or nullptr if there
+// isn't one, using the fastest method this CPU supports.
+const char *find_last_newline(const char *begin, const char *end)
+{
+#ifdef REVERSE_X86_SIMD
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2)
+        return find_last_newline_avx2(begin, end);
+    else
+        return find_last_newline_sse2(begin, end);
+#else
+    return find_last_newline_scalar(begin, end);
+#endif
+}
+
+//
+// Collects output in a big buffer, and writes it to a file descriptor with
+// one write system call each time the buffer fills up. Anything bigger than
+// the buffer is written directly.
+//
+class Output_buffer
+{
+    int fd;
+    vector<char> buffer;
+    size_t used = 0;
+
+    void write_all(const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                throw runtime_error(string("unable to write output: ") + strerror(errno));
+            data += n;
+            size -= n;
+        }
+    }
+
+public:
+    Output_buffer(int fd, size_t size = 1 << 20)
+        : fd(fd), buffer(size)
+    {
+    }
+
+    void write(const char *data, size_t size)
+    {
+        if (used + size > buffer.size())
+        {
+            flush();
+            if (size > buffer.size())
+            {
+                write_all(data, size);
+                return;
+            }
+        }
+        memcpy(buffer.data() + used, data, size);
+        used += size;
+    }
+
+    void flush()
+    {
+        write_all(buffer.data(), used);
+        used = 0;
+    }
+}; // class Output_buffer
+
+//
+// Writes the lines from begin to end to out in reverse order.
+//
+// The file is handled in windows of window_size bytes, from the end back to
+// the start. Before a window is scanned, the operating system is asked to
+// start reading the window before it (MADV_WILLNEED), and once a window is
+// written, its pages are dropped (MADV_DONTNEED), so the memory used stays
+// small however big the file is. Dropping pages of a read-only mapping is
+// safe: if they're needed again they are just read from the file again.
+//
+void reverse_lines(const char *begin, const char *end, Output_buffer &out)
+{
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t window_size = 16 << 20;
+
+    // Rounds p down to the start of its page. begin is page-aligned, since
+    // mmap always maps from the start of a page.
+    auto page_start = [&](const char *p)
+    { return begin + (p - begin) / page_size * page_size; };
+
+    // the end of the part of the file that has been written, rounded up to a
+    // page
+    const char *dropped_from = end;
+
+    if (begin == end)
+        return;
+
+    // a last line with no '\n' still counts as a line
+    const char *line_end = (end[-1] == '\n') ? end - 1 : end;
+    const char *window_start = end;
+    for (;;)
+    {
+        const char *newline = find_last_newline(begin, line_end);
+        const char *line_start = (newline == nullptr) ? begin : newline + 1;
+
+        // read ahead and drop pages a window at a time
+        if (line_start < window_start)
+        {
+            window_start = page_start(line_start - begin > window_size ? line_start - window_size : begin);
+            madvise(const_cast<char *>(window_start), line_start - window_start, MADV_WILLNEED);
+            const char *keep_from = page_start(line_end) + page_size;
+            if (keep_from < dropped_from)
+            {
+                madvise(const_cast<char *>(keep_from), dropped_from - keep_from, MADV_DONTNEED);
+                dropped_from = keep_from;
+            }
+        }
+
+        out.write(line_start, line_end - line_start);
+        out.write("\n", 1);
+        if (newline == nullptr)
+            break;
+        line_end = newline;
+    }
+    out.flush();
+} // reverse_lines
+
+//
+// A copy of standard input in a temporary file, for when standard input can't
+// be mapped. The file is deleted as soon as it is created, so it disappears
+// when it is closed (or the program ends) whatever happens.
+//
+class Stdin_copy
+{
+    int fd = -1;
+
+public:
+    Stdin_copy()
+    {
+        const char *tmp = getenv("TMPDIR");
+        string pattern = string(tmp != nullptr ? tmp : "/tmp") + "/reverse_lines.XXXXXX";
+        vector<char> fname(pattern.begin(), pattern.end());
+        fname.push_back('\0');
+        fd = mkstemp(fname.data());
+        if (fd == -1)
+            throw runtime_error("unable to create a temporary file from " + pattern);
+        unlink(fname.data());
+
+        Output_buffer out(fd);
+        vector<char> buffer(1 << 20);
+        for (;;)
+        {
+            ssize_t n = read(0, buffer.data(), buffer.size());
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n == -1)
+                throw runtime_error("unable to read standard input");
+            if (n == 0)
+                break;
+            out.write(buffer.data(), n);
+        }
+        out.flush();
+    }
+
+    ~Stdin_copy()
+    {
+        if (fd != -1)
+            close(fd);
+    }
+
+    Stdin_copy(const Stdin_copy &other) = delete;
+    Stdin_copy &operator=(const Stdin_copy &other) = delete;
+
+    int get_fd() const { return fd; }
+}; // class Stdin_copy
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        cout << "Usage: ./reverse_lines [filename]\n";
+        return 1;
+    }
+
+    try
+    {
+        Output_buffer out(1);
+        if (argc == 2)
+        {
+            cmpt::Mapped_file file(argv[1]);
+            if (!file.is_open())
+            {
+                cout << "Error: unable to map file \"" << argv[1] << "\"\n";
+                return 1;
+            }
+            reverse_lines(file.begin(), file.end(), out);
+        }
+        else
+        {
+            cmpt::Mapped_file file(0);
+            if (file.is_open())
+            {
+                reverse_lines(file.begin(), file.end(), out);
+            }
+            else
+            {
+                Stdin_copy copy;
+                cmpt::Mapped_file copy_file(copy.get_fd());
+                if (!copy_file.is_open())
+                    throw runtime_error("unable to map the copy of standard input");
+                reverse_lines(copy_file.begin(), copy_file.end(), out);
+            }
+        }
+    }
+    catch (const runtime_error &e)
+    {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
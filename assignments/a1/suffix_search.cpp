@@ -0,0 +1,596 @@
+// suffix_search.cpp
+
+//
+// Finds every place a string occurs in a text file, using a suffix array. For
+// each pattern, it prints how many times it occurs, and the first few places
+// it occurs (by line number and byte offset, counting from 0) along with the
+// line it's on:
+//
+//   > ./suffix_search -k 3 tiny_shakespeare.txt "the king"
+//   "the king": 157 matches
+//     line 5988, offset 155905: To set my brother Clarence and the king
+//     line 6032, offset 157184: 'Tis not the king that sends you to the Tower:
+//     line 6044, offset 157645: That trudge betwixt the king and Mistress Shore.
+//
+//   ./suffix_search [-k num_shown] [--benchmark] filename [pattern ...]
+//     -k: show the first num_shown matches of each pattern (the default is 10)
+//     --benchmark: time building the index, and compare the time for queries
+//                  using it against a linear search of the whole file
+//
+// With no patterns on the command line, each line read from cin is a pattern.
+//
+// Suffix Arrays
+// -------------
+// A suffix of the text is all the text from some position to the end, and the
+// suffix array is the start positions of all the suffixes, sorted into
+// alphabetical order of the suffixes. Every occurrence of a pattern is the
+// start of a suffix that begins with the pattern, and all those suffixes are
+// next to each other in the suffix array. So the first one can be found with
+// binary search, using O(m log n) character comparisons for a pattern of
+// length m in a text of length n, instead of the O(n) a linear search takes.
+//
+// The suffix array is built in O(n) time with the SA-IS algorithm (Nong, Zhang
+// and Chan, "Two Efficient Algorithms for Linear Time Suffix Array
+// Construction", 2011); see sais below.
+//
+// The index also has the LCP array: lcp[i] is the length of the longest common
+// prefix of the suffixes at sa[i - 1] and sa[i], built in O(n) time with
+// Kasai's algorithm. Once the first match is found, the matches continue for
+// as long as lcp[i] >= m, so the end of the matches is found by reading lcp in
+// order rather than by a second binary search that jumps all over the text. To
+// skip long runs of matches quickly, the smallest lcp value in each block of
+// lcp_block entries is saved too.
+//
+// Benchmark
+// ---------
+// The index takes 4 bytes per character for the suffix array and 4 bytes for
+// the LCP array, built from the mapped file (see cmpt_mapped_file.h). For
+// example:
+//
+//   > ./suffix_search --benchmark -k 0 tiny_shakespeare.txt
+//   built the index of 1115394 characters in 0.352958s (8.57627 MB, peak memory 17.332 MB)
+//   1000 queries, 4570423 matches in all:
+//     linear search: 1.12456 ms per query
+//     suffix array : 2.59477 us per query (433.396 times faster)
+//
+//   > ./suffix_search --benchmark tiny_shakespeare.txt
+//   ...
+//     linear search: 1.10563 ms per query
+//     suffix array : 45.3791 us per query (24.3642 times faster)
+//
+// The queries are random substrings of the text, 1 to 20 characters long,
+// plus some that don't occur. Each query finds the number of matches and the
+// first k (set with -k), and the two methods must find the same ones. Counting
+// is what the index is fastest at; finding the first k still has to look at
+// every match, since the matches are in suffix order, not text order, and
+// short patterns like "e" have tens of thousands of them.
+//
+
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace std;
+
+//
+// SA-IS
+// -----
+// s[0..n-1] is a string of integers from 0 to k - 1 whose last one is 0, and
+// 0 appears nowhere else (the "sentinel"). sais puts its suffix array in sa.
+//
+// A suffix is S-type if it's smaller than the suffix after it, and L-type if
+// it's bigger; the sentinel's suffix is S-type. An S-type suffix with an
+// L-type suffix just before it is a leftmost S-type, or LMS, suffix. If the
+// LMS suffixes are sorted, then placing them at the ends of their buckets (the
+// part of sa for suffixes starting with the same integer) and scanning sa
+// forwards and then backwards puts all the other suffixes in order ("induced
+// sorting"). The LMS suffixes are sorted by first sorting the LMS substrings
+// (from one LMS position to the next) with the same induced sort, naming each
+// one by its rank, and, if some names are the same, finding the suffix array
+// of the string of names recursively. That string is at most half as long, so
+// the total time is O(n).
+//
+
+// Sets bucket[c] to the start (or, if end is true, the end) of the bucket for
+// suffixes starting with c.
+void get_buckets(const int *s, int n, int k, vector<int> &bucket, bool end)
+{
+    fill(bucket.begin(), bucket.end(), 0);
+    for (int i = 0; i < n; i++)
+    {
+        bucket[s[i]]++;
+    }
+    int sum = 0;
+    for (int c = 0; c < k; c++)
+    {
+        int count = bucket[c];
+        sum += count;
+        bucket[c] = end ? sum : sum - count;
+    }
+}
+
+// Induces the order of the L-type suffixes from the LMS suffixes in sa, and
+// then the order of the S-type suffixes from the L-type ones.
+void induce(const int *s, int *sa, int n, int k, const vector<char> &is_s, vector<int> &bucket)
+{
+    get_buckets(s, n, k, bucket, false);
+    for (int i = 0; i < n; i++)
+    {
+        int j = sa[i] - 1;
+        if (sa[i] > 0 && !is_s[j])
+            sa[bucket[s[j]]++] = j;
+    }
+    get_buckets(s, n, k, bucket, true);
+    for (int i = n - 1; i >= 0; i--)
+    {
+        int j = sa[i] - 1;
+        if (sa[i] > 0 && is_s[j])
+            sa[--bucket[s[j]]] = j;
+    }
+}
+
+void sais(const int *s, int *sa, int n, int k)
+{
+    if (n == 1)
+    {
+        sa[0] = 0;
+        return;
+    }
+
+    vector<char> is_s(n);
+    is_s[n - 1] = true;
+    for (int i = n - 2; i >= 0; i--)
+    {
+        is_s[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && is_s[i + 1]);
+    }
+    auto is_lms = [&](int i)
+    { return i > 0 && is_s[i] && !is_s[i - 1]; };
+
+    // sort the LMS substrings
+    vector<int> bucket(k);
+    get_buckets(s, n, k, bucket, true);
+    fill(sa, sa + n, -1);
+    for (int i = 1; i < n; i++)
+    {
+        if (is_lms(i))
+            sa[--bucket[s[i]]] = i;
+    }
+    induce(s, sa, n, k, is_s, bucket);
+
+    // move the sorted LMS substrings to the start of sa
+    int n1 = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (is_lms(sa[i]))
+            sa[n1++] = sa[i];
+    }
+
+    // name them; LMS positions are at least 2 apart, so position / 2 is a
+    // unique place in the second half of sa for each name
+    fill(sa + n1, sa + n, -1);
+    int num_names = 0;
+    int prev = -1;
+    for (int i = 0; i < n1; i++)
+    {
+        int pos = sa[i];
+        bool different = false;
+        for (int d = 0; d < n; d++)
+        {
+            if (prev == -1 || s[pos + d] != s[prev + d] || is_s[pos + d] != is_s[prev + d])
+            {
+                different = true;
+                break;
+            }
+            if (d > 0 && (is_lms(pos + d) || is_lms(prev + d)))
+                break;
+        }
+        if (different)
+        {
+            num_names++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = num_names - 1;
+    }
+    for (int i = n - 1, j = n - 1; i >= n1; i--)
+    {
+        if (sa[i] >= 0)
+            sa[j--] = sa[i];
+    }
+
+    // sort the LMS suffixes, recursively if the names aren't all different
+    int *s1 = sa + n - n1;
+    int *sa1 = sa;
+    if (num_names < n1)
+    {
+        sais(s1, sa1, n1, num_names);
+    }
+    else
+    {
+        for (int i = 0; i < n1; i++)
+        {
+            sa1[s1[i]] = i;
+        }
+    }
+
+    // put the sorted LMS suffixes at the ends of their buckets, and induce
+    // the rest
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        if (is_lms(i))
+            s1[j++] = i;
+    }
+    for (int i = 0; i < n1; i++)
+    {
+        sa1[i] = s1[sa1[i]];
+    }
+    fill(sa + n1, sa + n, -1);
+    get_buckets(s, n, k, bucket, true);
+    for (int i = n1 - 1; i >= 0; i--)
+    {
+        int j = sa[i];
+        sa[i] = -1;
+        sa[--bucket[s[j]]] = j;
+    }
+    induce(s, sa, n, k, is_s, bucket);
+} // sais
+
+//
+// A suffix array and LCP array for a text. See "Suffix Arrays" at the top of
+// the file.
+//
+class Suffix_index
+{
+    static const int lcp_block = 64;
+
+    string_view text;
+    vector<int> sa;
+    vector<int> lcp;
+    vector<int> lcp_block_min;
+
+    // Returns the number of characters at the start of the suffix at pos that
+    // match pattern, starting the comparison at skip. Sets less to true if
+    // the suffix is less than pattern.
+    size_t match_length(int pos, string_view pattern, size_t skip, bool &less) const
+    {
+        const size_t rest = text.size() - pos;
+        size_t i = skip;
+        while (i < pattern.size() && i < rest && text[pos + i] == pattern[i])
+            i++;
+        if (i == pattern.size())
+            less = false;
+        else if (i == rest)
+            less = true;
+        else
+            less = static_cast<unsigned char>(text[pos + i]) < static_cast<unsigned char>(pattern[i]);
+        return i;
+    }
+
+public:
+    Suffix_index(string_view text)
+        : text(text)
+    {
+        const int n = text.size();
+
+        // the text's bytes are 1 to 256, so 0 can be the sentinel
+        vector<int> s(n + 1);
+        for (int i = 0; i < n; i++)
+        {
+            s[i] = static_cast<unsigned char>(text[i]) + 1;
+        }
+        s[n] = 0;
+        sa.resize(n + 1);
+        sais(s.data(), sa.data(), n + 1, 257);
+        sa.erase(sa.begin()); // the sentinel's suffix is always first
+
+        // Kasai's algorithm: the suffix at i + 1 shares at least h - 1
+        // characters with the suffix before it if the one at i shares h
+        vector<int> &rank = s;
+        for (int i = 0; i < n; i++)
+        {
+            rank[sa[i]] = i;
+        }
+        lcp.assign(n, 0);
+        int h = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (rank[i] == 0)
+            {
+                h = 0;
+                continue;
+            }
+            int j = sa[rank[i] - 1];
+            while (i + h < n && j + h < n && text[i + h] == text[j + h])
+                h++;
+            lcp[rank[i]] = h;
+            if (h > 0)
+                h--;
+        }
+
+        for (int i = 0; i < n; i += lcp_block)
+        {
+            lcp_block_min.push_back(*min_element(lcp.begin() + i, lcp.begin() + min(n, i + lcp_block)));
+        }
+    }
+
+    // the memory used by the index, not counting the text
+    size_t memory_used() const
+    {
+        return (sa.size() + lcp.size() + lcp_block_min.size()) * sizeof(int);
+    }
+
+    //
+    // Returns the range [first, last) of sa whose suffixes start with
+    // pattern. first is found by binary search, remembering how many
+    // characters of pattern match the suffixes at the two ends of the range
+    // left to search: every suffix in between matches at least the smaller of
+    // those, so the comparison can skip them.
+    //
+    pair<int, int> find(string_view pattern) const
+    {
+        const int n = sa.size();
+        if (pattern.empty())
+            return {0, n};
+
+        int low = 0;
+        int high = n;
+        size_t low_match = 0;
+        size_t high_match = 0;
+        while (low < high)
+        {
+            int mid = low + (high - low) / 2;
+            bool less;
+            size_t m = match_length(sa[mid], pattern, min(low_match, high_match), less);
+            if (less)
+            {
+                low = mid + 1;
+                low_match = m;
+            }
+            else
+            {
+                high = mid;
+                high_match = m;
+            }
+        }
+        const int first = low;
+        bool less;
+        if (first == n || match_length(sa[first], pattern, 0, less) < pattern.size())
+            return {first, first};
+
+        // the matches go on while lcp >= pattern.size()
+        const int m = pattern.size();
+        int last = first + 1;
+        while (last < n && last % lcp_block != 0 && lcp[last] >= m)
+            last++;
+        if (last < n && last % lcp_block == 0)
+        {
+            while (last + lcp_block <= n && lcp_block_min[last / lcp_block] >= m)
+                last += lcp_block;
+            while (last < n && lcp[last] >= m)
+                last++;
+        }
+        return {first, last};
+    }
+
+    // Returns the positions of the first (at most) k matches in range. The
+    // matches aren't in order of position in sa, so the k smallest positions
+    // seen so far are kept in a max-heap; most positions are bigger than the
+    // top of the heap and can be skipped right away.
+    vector<int> first_positions(pair<int, int> range, int k) const
+    {
+        vector<int> positions;
+        if (k == 0)
+            return positions;
+        for (int i = range.first; i < range.second; i++)
+        {
+            if (int(positions.size()) < k)
+            {
+                positions.push_back(sa[i]);
+                push_heap(positions.begin(), positions.end());
+            }
+            else if (sa[i] < positions.front())
+            {
+                pop_heap(positions.begin(), positions.end());
+                positions.back() = sa[i];
+                push_heap(positions.begin(), positions.end());
+            }
+        }
+        sort_heap(positions.begin(), positions.end());
+        return positions;
+    }
+}; // class Suffix_index
+
+//
+// The linear search the index is compared against: every position of pattern
+// in text, found with string_view::find.
+//
+vector<int> linear_search(string_view text, string_view pattern)
+{
+    vector<int> positions;
+    for (size_t pos = text.find(pattern); pos != string_view::npos; pos = text.find(pattern, pos + 1))
+    {
+        positions.push_back(pos);
+    }
+    return positions;
+}
+
+// Prints the number of matches of pattern and the first k of them.
+void print_matches(const Suffix_index &index, string_view text,
+                   const vector<size_t> &line_starts, const string &pattern, int k)
+{
+    pair<int, int> range = index.find(pattern);
+    const int count = range.second - range.first;
+    cout << "\"" << pattern << "\": " << count << (count == 1 ? " match\n" : " matches\n");
+    for (int pos : index.first_positions(range, k))
+    {
+        size_t line = upper_bound(line_starts.begin(), line_starts.end(), size_t(pos)) - line_starts.begin();
+        size_t start = line_starts[line - 1];
+        size_t end = text.find('\n', start);
+        if (end == string_view::npos)
+            end = text.size();
+        cout << "  line " << line << ", offset " << pos << ": " << text.substr(start, end - start) << "\n";
+    }
+}
+
+// Times queries with the index and with linear search, and checks that they
+// find the same number of matches and the same first k. Returns false if they
+// don't.
+bool benchmark(string_view text, int k)
+{
+    auto start = chrono::steady_clock::now();
+    Suffix_index index(text);
+    auto end = chrono::steady_clock::now();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << "built the index of " << text.size() << " characters in "
+         << chrono::duration<double>(end - start).count() << "s ("
+         << index.memory_used() / (1024.0 * 1024.0) << " MB, peak memory "
+         << usage.ru_maxrss / 1024.0 << " MB)\n";
+    if (text.empty())
+    {
+        cout << "the file is empty, so there is nothing to search for\n";
+        return true;
+    }
+
+    // random substrings, and every tenth one changed so it (probably) doesn't
+    // occur
+    const int num_queries = 1000;
+    mt19937_64 rng(1);
+    vector<string> queries;
+    for (int i = 0; i < num_queries; i++)
+    {
+        size_t length = 1 + rng() % 20;
+        size_t pos = rng() % text.size();
+        string q(text.substr(pos, length));
+        if (i % 10 == 0)
+            q.back() = '#';
+        queries.push_back(q);
+    }
+
+    // each result is the number of matches followed by the first k
+    vector<vector<int>> expected;
+    long long num_matches = 0;
+    start = chrono::steady_clock::now();
+    for (const string &q : queries)
+    {
+        vector<int> positions = linear_search(text, q);
+        num_matches += positions.size();
+        positions.insert(positions.begin(), positions.size());
+        positions.resize(min<size_t>(positions.size(), k + 1));
+        expected.push_back(positions);
+    }
+    end = chrono::steady_clock::now();
+    double linear_seconds = chrono::duration<double>(end - start).count();
+
+    vector<vector<int>> found;
+    start = chrono::steady_clock::now();
+    for (const string &q : queries)
+    {
+        pair<int, int> range = index.find(q);
+        vector<int> positions = index.first_positions(range, k);
+        positions.insert(positions.begin(), range.second - range.first);
+        found.push_back(positions);
+    }
+    end = chrono::steady_clock::now();
+    double index_seconds = chrono::duration<double>(end - start).count();
+
+    cout << queries.size() << " queries, " << num_matches << " matches in all:\n";
+    cout << "  linear search: " << linear_seconds / queries.size() * 1000 << " ms per query\n";
+    cout << "  suffix array : " << index_seconds / queries.size() * 1000000 << " us per query ("
+         << linear_seconds / index_seconds << " times faster)\n";
+    if (found != expected)
+    {
+        cout << "!! the suffix array and linear search found different matches\n";
+        return false;
+    }
+    return true;
+} // benchmark
+
+void usage()
+{
+    cout << "Usage: ./suffix_search [-k num_shown] [--benchmark] filename [pattern ...]\n";
+}
+
+int main(int argc, char *argv[])
+{
+    int k = 10;
+    bool run_benchmark = false;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-k")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            if (value.empty() || value.size() > 9 ||
+                value.find_first_not_of("0123456789") != string::npos)
+            {
+                cout << "Error: invalid number of matches to show \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+            k = stoi(value);
+        }
+        else if (arg == "--benchmark")
+        {
+            run_benchmark = true;
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+    if (args.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    cmpt::Mapped_file file(args[0]);
+    if (!file.is_open())
+    {
+        cout << "Error: unable to map file \"" << args[0] << "\"\n";
+        return 1;
+    }
+    if (file.size() >= (1u << 31) - 1)
+    {
+        cout << "Error: \"" << args[0] << "\" is too big (the limit is 2 GB)\n";
+        return 1;
+    }
+    string_view text(file.begin(), file.size());
+
+    if (run_benchmark)
+        return benchmark(text, k) ? 0 : 1;
+
+    Suffix_index index(text);
+    vector<size_t> line_starts = {0};
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '\n')
+            line_starts.push_back(i + 1);
+    }
+
+    if (args.size() > 1)
+    {
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            print_matches(index, text, line_starts, args[i], k);
+        }
+    }
+    else
+    {
+        string pattern;
+        while (getline(cin, pattern))
+        {
+            print_matches(index, text, line_starts, pattern, k);
+        }
+    }
+}
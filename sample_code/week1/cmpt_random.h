@@ -0,0 +1,95 @@
+// cmpt_random.h
+
+// By defining CMPT_RANDOM_H, we avoid problems caused by including this file
+// more than once: if CMPT_RANDOM_H is already defined, then the code is *not*
+// included.
+#ifndef CMPT_RANDOM_H
+#define CMPT_RANDOM_H
+
+#include <cstdint>
+
+namespace cmpt
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    // Random is the xoshiro256** random number generator by David Blackman and
+    // Sebastiano Vigna. It is much faster than rand() and has a period of
+    // 2^256 - 1. The seed is spread out over the 4 words of state using
+    // splitmix64, so the same seed always gives the same numbers. For example:
+    //
+    //     cmpt::Random rng(42);
+    //     int die = 1 + rng.below(6);   // 1 to 6
+    //     double u = rng.unit();        // more than 0, at most 1
+    //
+    ////////////////////////////////////////////////////////////////////////////
+    class Random
+    {
+        uint64_t s[4];
+
+        static uint64_t rotl(uint64_t x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+    public:
+        Random(uint64_t seed)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                seed += 0x9e3779b97f4a7c15;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+                s[i] = z ^ (z >> 31);
+            }
+        }
+
+        // Returns a random 64-bit number.
+        uint64_t next()
+        {
+            uint64_t result = rotl(s[1] * 5, 7) * 9;
+            uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        //
+        // Returns a random number from 0 to n - 1, with every number equally
+        // likely. rand() % n is biased towards small numbers when n doesn't
+        // divide evenly into the range of rand(). Instead, this takes the high
+        // 64 bits of next() * n, and rejects the few values of next() that
+        // would make some results more likely than others (Daniel Lemire's
+        // method). Rejection is rare, and the check usually costs one
+        // comparison.
+        //
+        uint64_t below(uint64_t n)
+        {
+            __uint128_t m = static_cast<__uint128_t>(next()) * n;
+            uint64_t low = m;
+            if (low < n)
+            {
+                uint64_t threshold = -n % n;
+                while (low < threshold)
+                {
+                    m = static_cast<__uint128_t>(next()) * n;
+                    low = m;
+                }
+            }
+            return m >> 64;
+        }
+
+        // Returns a random number greater than 0 and at most 1.
+        double unit()
+        {
+            return ((next() >> 11) + 1) * 0x1.0p-53;
+        }
+    }; // class Random
+
+} // namespace cmpt
+
+#endif
@@ -0,0 +1,58 @@
+// cmpt_size.h
+
+// By defining CMPT_SIZE_H, we avoid problems caused by including this file
+// more than once: if CMPT_SIZE_H is already defined, then the code is *not*
+// included.
+#ifndef CMPT_SIZE_H
+#define CMPT_SIZE_H
+
+#include <climits>
+#include <string>
+
+namespace cmpt
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    // parse_size converts a size like "4096", "500K", "100M" or "2G" to a
+    // number of bytes. The suffixes K, M and G (or k, m and g) multiply by
+    // 1024, 1024^2 and 1024^3. It returns 0 if s isn't a valid size, if the
+    // size isn't more than 0, or if the number of bytes is too big to fit in a
+    // long long. For example:
+    //
+    //     cmpt::parse_size("2G")                    // 2147483648
+    //     cmpt::parse_size("1.5G")                  // 0, not a whole number
+    //     cmpt::parse_size("9999999999999999999K")  // 0, too big
+    //
+    ////////////////////////////////////////////////////////////////////////////
+    inline long long parse_size(const std::string &s)
+    {
+        std::size_t used = 0;
+        long long n = 0;
+        try
+        {
+            n = std::stoll(s, &used);
+        }
+        catch (...)
+        {
+            return 0;
+        }
+
+        long long multiplier = 1;
+        std::string suffix = s.substr(used);
+        if (suffix == "K" || suffix == "k")
+            multiplier = 1024LL;
+        else if (suffix == "M" || suffix == "m")
+            multiplier = 1024LL * 1024;
+        else if (suffix == "G" || suffix == "g")
+            multiplier = 1024LL * 1024 * 1024;
+        else if (suffix != "")
+            return 0;
+
+        if (n <= 0 || n > LLONG_MAX / multiplier)
+            return 0;
+        return n * multiplier;
+    }
+
+} // namespace cmpt
+
+#endif
@@ -4,6 +4,7 @@
 // Checks if any lines in a file are longer than a given length.
 //
 
+#include "cmpt_block_reader.h"
 #include <iostream>
 
 using namespace std;
@@ -16,8 +17,9 @@ int main()
     int current_line_length = 0;
     int num_long_lines = 0;
 
+    cmpt::Block_reader in; // reads cin in large blocks
     char c;
-    while (cin.get(c))
+    while (in.get(c))
     {
         if (c == '\n')
         {
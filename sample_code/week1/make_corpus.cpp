@@ -0,0 +1,309 @@
+// make_corpus.cpp
+
+//
+// Writes a big synthetic text file for benchmarking programs like count_chars,
+// line_check, mysort, shuffle and is_sorted. The sample files that come with
+// the course are less than 1 MB, which is too small to show how a program
+// scales; this makes files of any size, e.g. a few GB.
+//
+// The output is made to look like the given source files. Each output line
+// is modelled on one source file, chosen in proportion to how many lines it
+// has. Its length is the length of a random line from that source, and it is
+// filled with words picked at random from that source, so common words are
+// common in the output too. So the output has about the same word and line
+// length distributions as each source.
+//
+//   > ./make_corpus --size 200M --seed 1 wordcount/austenPride.txt > /tmp/austen200M.txt
+//   wrote 209715242 bytes, 4189829 lines to standard output in 10.7165s
+//
+// Options:
+//
+//   --size n        stop after writing n bytes (K, M or G can be added to n);
+//                   the default is 100M
+//   --seed n        the random seed; the same seed, sources and options always
+//                   give exactly the same output (the default is 1)
+//   --skew s        how much to stretch the line lengths; each length is
+//                   multiplied by 1/u^s for a random u from 0 to 1, so 0 (the
+//                   default) keeps the source lengths and bigger values give
+//                   a longer tail of very long lines
+//   --dup-ratio r   the fraction of lines, from 0 to 1, that are exact copies
+//                   of an earlier line (the default is 0)
+//   --out fname     write to fname instead of cout
+//
+// The end of the run is reported to cerr.
+//
+
+#include "cmpt_random.h"
+#include "cmpt_size.h"
+#include "cmpt_tokenizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+//
+// What a source file looks like: every word in it, in order (so picking a
+// random one picks common words more often), and the length of every line.
+// The words point into the mapped file.
+//
+struct Source
+{
+    cmpt::Tokenizer file;
+    vector<string_view> words;
+    vector<size_t> line_lengths;
+
+    Source(const string &fname)
+        : file(fname, cmpt::Tokenizer::words)
+    {
+        if (!file.is_open() || !file.tokens_stay_valid())
+            return;
+        string_view w;
+        while (file.next(w))
+        {
+            words.push_back(w);
+        }
+
+        cmpt::Tokenizer lines(fname, cmpt::Tokenizer::lines);
+        string_view line;
+        while (lines.next(line))
+        {
+            line_lengths.push_back(line.size());
+        }
+    }
+};
+
+struct Options
+{
+    long long size = 100 * 1024 * 1024;
+    uint64_t seed = 1;
+    double skew = 0;
+    double dup_ratio = 0;
+    string out_fname;
+};
+
+//
+// Writes about opt.size bytes of lines modelled on sources to out, and sets
+// num_bytes and num_lines to how much was written. Lines are built one at a
+// time in line, and collected in a 1 MB buffer that is written out when it's
+// full.
+//
+void make_corpus(const vector<unique_ptr<Source>> &sources, const Options &opt, ostream &out,
+                 long long &num_bytes, long long &num_lines)
+{
+    // the longest line that --skew can make
+    const size_t max_line_length = 1 << 20;
+
+    // recent lines, that duplicate lines are copied from
+    const int max_recent = 4096;
+    vector<string> recent;
+
+    // each source is picked in proportion to its number of lines
+    vector<long long> cumulative_lines;
+    long long total_lines = 0;
+    for (const unique_ptr<Source> &source : sources)
+    {
+        total_lines += source->line_lengths.size();
+        cumulative_lines.push_back(total_lines);
+    }
+
+    cmpt::Random rng(opt.seed);
+    string buffer;
+    buffer.reserve(1 << 21);
+    string line;
+    num_bytes = 0;
+    num_lines = 0;
+    while (num_bytes < opt.size)
+    {
+        if (!recent.empty() && rng.unit() <= opt.dup_ratio)
+        {
+            line = recent[rng.below(recent.size())];
+        }
+        else
+        {
+            long long r = rng.below(total_lines);
+            int s = upper_bound(cumulative_lines.begin(), cumulative_lines.end(), r) - cumulative_lines.begin();
+            const Source &source = *sources[s];
+
+            size_t length = source.line_lengths[rng.below(source.line_lengths.size())];
+            if (opt.skew > 0)
+                length = min<double>(max_line_length, length / pow(rng.unit(), opt.skew));
+
+            // add words until the next one would make the line too long, but
+            // always use at least one word so a non-empty line isn't empty
+            line.clear();
+            while (line.size() < length && !source.words.empty())
+            {
+                string_view w = source.words[rng.below(source.words.size())];
+                size_t new_size = line.size() + (line.empty() ? 0 : 1) + w.size();
+                if (new_size > length && !line.empty())
+                    break;
+                if (!line.empty())
+                    line += ' ';
+                line += w;
+            }
+
+            if (opt.dup_ratio > 0)
+            {
+                if (recent.size() < max_recent)
+                    recent.push_back(line);
+                else
+                    recent[rng.below(max_recent)] = line;
+            }
+        }
+
+        buffer += line;
+        buffer += '\n';
+        num_bytes += line.size() + 1;
+        num_lines++;
+        if (buffer.size() >= (1 << 20))
+        {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    out.write(buffer.data(), buffer.size());
+} // make_corpus
+
+// Converts s to a number from low to high and stores it in x. Returns false,
+// and doesn't change x, if s isn't a number in that range.
+bool parse_double(const string &s, double low, double high, double &x)
+{
+    try
+    {
+        size_t used = 0;
+        double d = stod(s, &used);
+        if (used != s.size() || !(d >= low && d <= high))
+            return false;
+        x = d;
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+void usage()
+{
+    cout << "Usage: ./make_corpus [--size n] [--seed n] [--skew s] [--dup-ratio r]\n";
+    cout << "                     [--out fname] source1 [source2 ...]\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    vector<string> source_fnames;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        const vector<string> value_options = {"--size", "--seed", "--skew", "--dup-ratio", "--out"};
+        if (find(value_options.begin(), value_options.end(), arg) != value_options.end())
+        {
+            if (i + 1 == argc)
+            {
+                cout << "Error: missing value for " << arg << "\n";
+                usage();
+                return 1;
+            }
+            string value = argv[++i];
+            bool ok = true;
+            if (arg == "--size")
+            {
+                opt.size = cmpt::parse_size(value);
+                ok = (opt.size > 0);
+            }
+            else if (arg == "--seed")
+            {
+                ok = !value.empty() && value.size() <= 19 &&
+                     value.find_first_not_of("0123456789") == string::npos;
+                if (ok)
+                    opt.seed = stoull(value);
+            }
+            else if (arg == "--skew")
+                ok = parse_double(value, 0, 10, opt.skew);
+            else if (arg == "--dup-ratio")
+                ok = parse_double(value, 0, 1, opt.dup_ratio);
+            else if (arg == "--out")
+                opt.out_fname = value;
+
+            if (!ok)
+            {
+                cout << "Error: invalid value for " << arg << ": \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+        }
+        else if (arg[0] == '-')
+        {
+            cout << "Error: unknown option \"" << arg << "\"\n";
+            usage();
+            return 1;
+        }
+        else
+        {
+            source_fnames.push_back(arg);
+        }
+    }
+    if (source_fnames.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    vector<unique_ptr<Source>> sources;
+    for (const string &fname : source_fnames)
+    {
+        sources.push_back(make_unique<Source>(fname));
+        if (!sources.back()->file.is_open())
+        {
+            cout << "Error: unable to open file \"" << fname << "\"\n";
+            return 1;
+        }
+        if (!sources.back()->file.tokens_stay_valid())
+        {
+            cout << "Error: \"" << fname << "\" is not a regular file\n";
+            return 1;
+        }
+        if (sources.back()->line_lengths.empty())
+        {
+            cout << "Error: \"" << fname << "\" has no lines\n";
+            return 1;
+        }
+    }
+
+    ofstream outfile;
+    if (!opt.out_fname.empty())
+    {
+        outfile.open(opt.out_fname);
+        if (!outfile)
+        {
+            cout << "Error: unable to write to \"" << opt.out_fname << "\"\n";
+            return 1;
+        }
+    }
+    ostream &out = opt.out_fname.empty() ? cout : outfile;
+
+    auto start = chrono::steady_clock::now();
+    long long num_bytes = 0;
+    long long num_lines = 0;
+    make_corpus(sources, opt, out, num_bytes, num_lines);
+    out.flush();
+    auto end = chrono::steady_clock::now();
+    if (!out)
+    {
+        cerr << "Error: writing the output failed\n";
+        return 1;
+    }
+
+    cerr << "wrote " << num_bytes << " bytes, " << num_lines << " lines to "
+         << (opt.out_fname.empty() ? "standard output" : opt.out_fname) << " in "
+         << chrono::duration<double>(end - start).count() << "s\n";
+}
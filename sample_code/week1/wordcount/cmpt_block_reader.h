@@ -0,0 +1,97 @@
+// cmpt_block_reader.h
+
+// By defining CMPT_BLOCK_READER_H, we avoid problems caused by including this
+// file more than once: if CMPT_BLOCK_READER_H is already defined, then the
+// code is *not* included.
+#ifndef CMPT_BLOCK_READER_H
+#define CMPT_BLOCK_READER_H
+
+#include <cerrno>
+#include <cstddef>
+#include <vector>
+
+#include <unistd.h>
+
+namespace cmpt
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    // Block_reader is a fast replacement for reading cin one character at a
+    // time with cin.get(c). Every call to cin.get goes through the iostream
+    // library (which, by default, also keeps itself in sync with C's stdio).
+    // Block_reader instead uses the Linux read system call to read a large
+    // block of bytes at once, and then hands out characters from that block.
+    // For example:
+    //
+    //     cmpt::Block_reader in; // reads from standard input, i.e. cin
+    //     char c;
+    //     while (in.get(c))
+    //     {
+    //         // ... use c ...
+    //     }
+    //
+    // Don't mix Block_reader and cin on the same input: Block_reader reads
+    // ahead, so cin won't see the characters it has already read.
+    //
+    ////////////////////////////////////////////////////////////////////////////
+    class Block_reader
+    {
+        int fd;
+        std::vector<char> buffer;
+        size_t next = 0;   // index in buffer of the next character to return
+        size_t filled = 0; // number of characters in buffer
+
+        // Read the next block into buffer. Returns false at the end of the
+        // input, or if there's an error.
+        bool refill()
+        {
+            for (;;)
+            {
+                ssize_t n = read(fd, buffer.data(), buffer.size());
+                if (n > 0)
+                {
+                    next = 0;
+                    filled = n;
+                    return true;
+                }
+                if (n == -1 && errno == EINTR)
+                    continue; // interrupted by a signal, so try again
+                next = 0;
+                filled = 0;
+                return false;
+            }
+        }
+
+    public:
+        // fd is the file descriptor to read from; 0 is standard input.
+        Block_reader(int fd = 0, size_t block_size = 1 << 20)
+            : fd(fd), buffer(block_size)
+        {
+        }
+
+        // Sets c to the next character. Returns false if there are no more
+        // characters.
+        bool get(char &c)
+        {
+            if (next == filled && !refill())
+                return false;
+            c = buffer[next++];
+            return true;
+        }
+
+        // Sets begin and end to the next block of unread characters, and marks
+        // them all as read. Returns false if there are no more characters.
+        bool get_block(const char *&begin, const char *&end)
+        {
+            if (next == filled && !refill())
+                return false;
+            begin = buffer.data() + next;
+            end = buffer.data() + filled;
+            next = filled;
+            return true;
+        }
+    }; // class Block_reader
+
+} // namespace cmpt
+
+#endif
@@ -4,7 +4,7 @@
 // Counts the number of characters, lines, and words in a file. Similar to the
 // standard Linux wc utility program.
 //
-// The file is read from cin, e.g.:
+// The file is read from standard input (cin), e.g.:
 //
 //    > ./count_chars < austenPride.txt
 //    #chars: 704158
@@ -12,7 +12,12 @@
 //    #tabs : 0
 //    #words: 124580
 //
+// The input is read with a cmpt::Block_reader, which reads large blocks of
+// characters at a time and so is much faster than calling cin.get(c) for every
+// character.
+//
 
+#include "cmpt_block_reader.h"
 #include <iostream>
 
 using namespace std;
@@ -45,8 +50,9 @@ int main()
     //
     // process the input one character at a time
     //
+    cmpt::Block_reader in;
     char c;
-    while (cin.get(c))
+    while (in.get(c))
     {
         num_chars++;
         switch (c)
@@ -0,0 +1,110 @@
+// cmpt_mapped_file.h
+
+// By defining CMPT_MAPPED_FILE_H, we avoid problems caused by including this
+// file more than once: if CMPT_MAPPED_FILE_H is already defined, then the code
+// is *not* included.
+#ifndef CMPT_MAPPED_FILE_H
+#define CMPT_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cmpt
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    // Mapped_file uses the Linux mmap system call to make the contents of a
+    // file appear in memory as one big array of chars. Nothing is copied: the
+    // operating system reads pages of the file in as they are touched. For
+    // example:
+    //
+    //     cmpt::Mapped_file file("austenPride.txt");
+    //     if (file.is_open())
+    //     {
+    //         for (const char *p = file.begin(); p != file.end(); p++)
+    //         {
+    //             // ... use *p ...
+    //         }
+    //     }
+    //
+    // Only regular files can be mapped. For anything else, e.g. a pipe or a
+    // terminal, is_open() returns false and the caller should read the file
+    // some other way, e.g. with an fstream.
+    //
+    ////////////////////////////////////////////////////////////////////////////
+    class Mapped_file
+    {
+        const char *start = nullptr;
+        size_t length = 0;
+        bool opened = false;
+
+        // Map the whole of the already-open file fd, if it's a regular file.
+        void map(int fd)
+        {
+            struct stat info;
+            if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+                return;
+
+            if (info.st_size == 0)
+            {
+                // mmap can't map 0 bytes, but an empty file is still a
+                // perfectly good file
+                opened = true;
+                return;
+            }
+
+            void *p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                madvise(p, info.st_size, MADV_SEQUENTIAL);
+                start = static_cast<const char *>(p);
+                length = info.st_size;
+                opened = true;
+            }
+        }
+
+    public:
+        Mapped_file(const std::string &fname)
+        {
+            int fd = open(fname.c_str(), O_RDONLY);
+            if (fd == -1)
+                return;
+            map(fd);
+
+            // the mapping stays valid after the file descriptor is closed
+            close(fd);
+        }
+
+        // Maps a file that is already open, e.g. Mapped_file(0) maps standard
+        // input when it has been re-directed from a file with <. fd is not
+        // closed.
+        Mapped_file(int fd)
+        {
+            map(fd);
+        }
+
+        ~Mapped_file()
+        {
+            if (start != nullptr)
+                munmap(const_cast<char *>(start), length);
+        }
+
+        // A Mapped_file owns its mapping, so copying is not allowed.
+        Mapped_file(const Mapped_file &other) = delete;
+        Mapped_file &operator=(const Mapped_file &other) = delete;
+
+        bool is_open() const { return opened; }
+
+        const char *begin() const { return start; }
+        const char *end() const { return start + length; }
+        size_t size() const { return length; }
+    }; // class Mapped_file
+
+} // namespace cmpt
+
+#endif
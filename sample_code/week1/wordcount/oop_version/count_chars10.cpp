@@ -0,0 +1,380 @@
+// count_chars10.cpp
+
+//
+// Based on count_chars9. Files can be counted at the same time on multiple
+// threads. The option -j N starts N worker threads, and each worker repeatedly
+// takes the next file that hasn't been counted yet. Results are still printed
+// in the same order as the files on the command-line, and when more than one
+// file is given a total is printed at the end. The -t option also prints how
+// long each file took to count.
+//
+//   > ./count_chars10 -j 4 -t austenPride.txt poem.txt
+//   austenPride.txt:
+//      #chars: 704158
+//      #lines: 13427
+//      #tabs : 0
+//      #words: 124580
+//      time  : 0.000312s
+//
+//   poem.txt:
+//      #chars: 82
+//      #lines: 5
+//      #tabs : 0
+//      #words: 14
+//      time  : 0.000011s
+//
+//   total:
+//      #chars: 704240
+//      #lines: 13432
+//      #tabs : 0
+//      #words: 124594
+//
+
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COUNT_X86_SIMD
+#endif
+
+using namespace std;
+
+struct Count
+{
+    long long num_chars = 0;
+    long long num_lines = 0;
+    long long num_tabs = 0;
+    long long num_words = 0;
+
+    // true when the next whitespace character starts a new run of whitespace
+    bool first_whitespace = true;
+
+    // Update the counts for one character. This is the scalar reference that
+    // the SIMD versions must agree with.
+    void add(char c)
+    {
+        num_chars++;
+        switch (c)
+        {
+        case '\n':
+            num_lines++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case '\t':
+            num_tabs++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case ' ':
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        default:
+            first_whitespace = true;
+        } // switch
+    }
+
+    void add_scalar(const char *begin, const char *end)
+    {
+        for (const char *p = begin; p != end; p++)
+        {
+            add(*p);
+        }
+    }
+
+    //
+    // The SIMD versions compare a block of characters against '\n', '\t', and
+    // ' ' all at once, and turn each comparison into a bit mask with one bit
+    // per character. Counting lines and tabs is then just counting 1 bits.
+    //
+    // A whitespace character starts a new word gap when the character before
+    // it is *not* whitespace. Shifting the whitespace mask left by 1 lines each
+    // character up with the one before it, and the low bit is filled in from
+    // first_whitespace so that runs of whitespace that cross from one block to
+    // the next are only counted once.
+    //
+    void add_block_masks(unsigned newlines, unsigned tabs, unsigned spaces, int block_size)
+    {
+        unsigned whitespace = newlines | tabs | spaces;
+        unsigned before = (whitespace << 1) | (first_whitespace ? 0 : 1);
+
+        num_chars += block_size;
+        num_lines += __builtin_popcount(newlines);
+        num_tabs += __builtin_popcount(tabs);
+        num_words += __builtin_popcount(whitespace & ~before);
+        first_whitespace = ((whitespace >> (block_size - 1)) & 1) == 0;
+    }
+
+#ifdef COUNT_X86_SIMD
+    void add_sse2(const char *begin, const char *end)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i space = _mm_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            add_block_masks(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, space)),
+                            16);
+        }
+        add_scalar(p, end);
+    }
+
+    __attribute__((target("avx2"))) void add_avx2(const char *begin, const char *end)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i space = _mm256_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            add_block_masks(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)),
+                            32);
+        }
+        add_scalar(p, end);
+    }
+#endif
+
+    // Update the counts for all the characters from begin up to, but not
+    // including, end, using the fastest method this CPU supports.
+    void add(const char *begin, const char *end)
+    {
+#ifdef COUNT_X86_SIMD
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2)
+            add_avx2(begin, end);
+        else
+            add_sse2(begin, end);
+#else
+        add_scalar(begin, end);
+#endif
+    }
+
+    // Update the counts for all the characters read from in. The characters
+    // are read in large blocks so the SIMD code can be used.
+    void add(istream &in)
+    {
+        vector<char> buffer(1 << 16);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+        {
+            add(buffer.data(), buffer.data() + in.gcount());
+        }
+    }
+
+    // Add the counts from other to this one, e.g. to calculate a total.
+    void operator+=(const Count &other)
+    {
+        num_chars += other.num_chars;
+        num_lines += other.num_lines;
+        num_tabs += other.num_tabs;
+        num_words += other.num_words;
+    }
+}; // Count
+
+void print(const Count &count)
+{
+    cout << "   #chars: " << count.num_chars << "\n";
+    cout << "   #lines: " << count.num_lines << "\n";
+    cout << "   #tabs : " << count.num_tabs << "\n";
+    cout << "   #words: " << count.num_words << "\n";
+}
+
+Count process_file(const string &fname)
+{
+    Count count;
+
+    if (fname == "-")
+    {
+        count.add(cin);
+        return count;
+    }
+
+    cmpt::Mapped_file file(fname);
+    if (file.is_open())
+    {
+        count.add(file.begin(), file.end());
+    }
+    else
+    {
+        // not a regular file, so read it as a stream
+        ifstream infile(fname);
+        count.add(infile);
+    }
+    return count;
+} // process_file
+
+// The result of counting one file.
+struct Result
+{
+    Count count;
+    double seconds = 0;
+    bool done = false;
+};
+
+//
+// Counts all the files using num_threads worker threads, and prints the results
+// in the same order as fnames.
+//
+// Each worker takes the index of the next uncounted file from next_file. When
+// it finishes a file it marks its Result as done and wakes up the main thread,
+// which prints results in order as soon as they are ready. So the first file
+// is printed as soon as it's counted, even if later files are still being
+// worked on.
+//
+void process_files(const vector<string> &fnames, int num_threads, bool show_time)
+{
+    vector<Result> results(fnames.size());
+    atomic<int> next_file(0);
+    mutex results_mutex;
+    condition_variable result_ready;
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            int i = next_file++;
+            if (i >= fnames.size())
+                return;
+
+            auto start = chrono::steady_clock::now();
+            Count count = process_file(fnames[i]);
+            auto end = chrono::steady_clock::now();
+
+            lock_guard<mutex> lock(results_mutex);
+            results[i].count = count;
+            results[i].seconds = chrono::duration<double>(end - start).count();
+            results[i].done = true;
+            result_ready.notify_one();
+        }
+    };
+
+    // there's no point in more workers than files; and if the system won't
+    // start as many threads as asked for, the ones that did start take all
+    // the files between them (or, if none did, this thread counts them all
+    // before printing)
+    vector<thread> workers;
+    for (int t = 0; t < min<size_t>(num_threads, fnames.size()); t++)
+    {
+        try
+        {
+            workers.push_back(thread(worker));
+        }
+        catch (const system_error &)
+        {
+            break;
+        }
+    }
+    if (workers.empty())
+        worker();
+
+    Count total;
+    cout << fixed << setprecision(6);
+    for (int i = 0; i < fnames.size(); i++)
+    {
+        unique_lock<mutex> lock(results_mutex);
+        result_ready.wait(lock, [&]() { return results[i].done; });
+        lock.unlock();
+
+        if (i > 0)
+            cout << "\n";
+        cout << fnames[i] << ":\n";
+        print(results[i].count);
+        if (show_time)
+            cout << "   time  : " << results[i].seconds << "s\n";
+        total += results[i].count;
+    }
+
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+
+    if (fnames.size() > 1)
+    {
+        cout << "\ntotal:\n";
+        print(total);
+    }
+} // process_files
+
+// the most threads -j can ask for
+const int max_threads = 1024;
+
+void usage()
+{
+    cout << "Usage: ./count_chars10 [-j num_threads] [-t] file1 [file2 ...]\n";
+    cout << "  -j: number of files to count at the same time, up to 1024 (default 1)\n";
+    cout << "  -t: print how long each file took to count\n";
+}
+
+int main(int argc, char *argv[])
+{
+    int num_threads = 1;
+    bool show_time = false;
+    vector<string> fnames;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-j")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            try
+            {
+                num_threads = stoi(value);
+            }
+            catch (...)
+            {
+                num_threads = 0;
+            }
+            if (num_threads < 1 || num_threads > max_threads)
+            {
+                cout << "Invalid number of threads: \"" << value << "\"\n";
+                usage();
+                return -1;
+            }
+        }
+        else if (arg == "-t")
+        {
+            show_time = true;
+        }
+        else
+        {
+            fnames.push_back(arg);
+        }
+    }
+
+    // check that one or more filename arguments provided
+    if (fnames.empty())
+    {
+        cout << "Wrong number of arguments\n";
+        usage();
+        return -1;
+    }
+
+    process_files(fnames, num_threads, show_time);
+}
@@ -0,0 +1,459 @@
+// count_chars11.cpp
+
+//
+// Based on count_chars9. count_chars10 speeds up counting lots of files by
+// counting different files at the same time, but that doesn't help with one
+// very big file. So this version splits each memory-mapped file into chunks
+// and counts the chunks at the same time on multiple threads. The counts for
+// the chunks are then merged together.
+//
+// The tricky part is words: a run of whitespace that crosses from one chunk
+// into the next would be counted once in each chunk, so when two chunks are
+// merged one word is subtracted if that happened (see merge below).
+//
+//   > ./count_chars11 -j 4 austenPride.txt
+//   austenPride.txt:
+//      #chars: 704158
+//      #lines: 13427
+//      #tabs : 0
+//      #words: 124580
+//
+// -c sets the chunk size in bytes (by default the file is split into one
+// chunk per thread), and --check compares the chunked counts for a range of
+// chunk sizes, down to 1 byte, against the serial counts:
+//
+//   > ./count_chars11 --check austenPride.txt
+//   austenPride.txt: chunk sizes 1 2 3 7 16 31 32 33 4096 65536 1000000 agree
+//
+
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COUNT_X86_SIMD
+#endif
+
+using namespace std;
+
+struct Count
+{
+    long long num_chars = 0;
+    long long num_lines = 0;
+    long long num_tabs = 0;
+    long long num_words = 0;
+
+    // true when the next whitespace character starts a new run of whitespace
+    bool first_whitespace = true;
+
+    // true when the first character counted was whitespace; merge needs this
+    // to tell if a run of whitespace continues from the chunk before
+    bool starts_with_whitespace = false;
+
+    // Update the counts for one character. This is the scalar reference that
+    // the SIMD versions must agree with.
+    void add(char c)
+    {
+        num_chars++;
+        switch (c)
+        {
+        case '\n':
+            num_lines++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case '\t':
+            num_tabs++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case ' ':
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        default:
+            first_whitespace = true;
+        } // switch
+    }
+
+    void add_scalar(const char *begin, const char *end)
+    {
+        for (const char *p = begin; p != end; p++)
+        {
+            add(*p);
+        }
+    }
+
+    //
+    // The SIMD versions compare a block of characters against '\n', '\t', and
+    // ' ' all at once, and turn each comparison into a bit mask with one bit
+    // per character. Counting lines and tabs is then just counting 1 bits.
+    //
+    // A whitespace character starts a new word gap when the character before
+    // it is *not* whitespace. Shifting the whitespace mask left by 1 lines each
+    // character up with the one before it, and the low bit is filled in from
+    // first_whitespace so that runs of whitespace that cross from one block to
+    // the next are only counted once.
+    //
+    void add_block_masks(unsigned newlines, unsigned tabs, unsigned spaces, int block_size)
+    {
+        unsigned whitespace = newlines | tabs | spaces;
+        unsigned before = (whitespace << 1) | (first_whitespace ? 0 : 1);
+
+        num_chars += block_size;
+        num_lines += __builtin_popcount(newlines);
+        num_tabs += __builtin_popcount(tabs);
+        num_words += __builtin_popcount(whitespace & ~before);
+        first_whitespace = ((whitespace >> (block_size - 1)) & 1) == 0;
+    }
+
+#ifdef COUNT_X86_SIMD
+    void add_sse2(const char *begin, const char *end)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i space = _mm_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            add_block_masks(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, space)),
+                            16);
+        }
+        add_scalar(p, end);
+    }
+
+    __attribute__((target("avx2"))) void add_avx2(const char *begin, const char *end)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i space = _mm256_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            add_block_masks(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)),
+                            32);
+        }
+        add_scalar(p, end);
+    }
+#endif
+
+    // Update the counts for all the characters from begin up to, but not
+    // including, end, using the fastest method this CPU supports.
+    void add(const char *begin, const char *end)
+    {
+#ifdef COUNT_X86_SIMD
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2)
+            add_avx2(begin, end);
+        else
+            add_sse2(begin, end);
+#else
+        add_scalar(begin, end);
+#endif
+    }
+
+    // Update the counts for all the characters read from in. The characters
+    // are read in large blocks so the SIMD code can be used.
+    void add(istream &in)
+    {
+        vector<char> buffer(1 << 16);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+        {
+            add(buffer.data(), buffer.data() + in.gcount());
+        }
+    }
+}; // Count
+
+bool operator==(const Count &a, const Count &b)
+{
+    return a.num_chars == b.num_chars && a.num_lines == b.num_lines &&
+           a.num_tabs == b.num_tabs && a.num_words == b.num_words &&
+           a.first_whitespace == b.first_whitespace;
+}
+
+bool is_whitespace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+// Count the characters from begin up to, but not including, end, as if they
+// were a file all by themselves.
+Count count_chunk(const char *begin, const char *end)
+{
+    Count count;
+    if (begin != end)
+        count.starts_with_whitespace = is_whitespace(*begin);
+    count.add(begin, end);
+    return count;
+}
+
+//
+// Returns the counts for chunk a followed immediately by chunk b.
+//
+// Each chunk is counted as if it were the start of a file, and so a chunk that
+// starts with whitespace always counts a word for it. If the chunk before it
+// ended with whitespace, then that whitespace run was already counted by the
+// chunk before, and so one word is subtracted.
+//
+Count merge(const Count &a, const Count &b)
+{
+    if (a.num_chars == 0)
+        return b;
+    if (b.num_chars == 0)
+        return a;
+
+    Count result;
+    result.num_chars = a.num_chars + b.num_chars;
+    result.num_lines = a.num_lines + b.num_lines;
+    result.num_tabs = a.num_tabs + b.num_tabs;
+    result.num_words = a.num_words + b.num_words;
+    if (b.starts_with_whitespace && !a.first_whitespace)
+        result.num_words--;
+    result.first_whitespace = b.first_whitespace;
+    result.starts_with_whitespace = a.starts_with_whitespace;
+    return result;
+}
+
+//
+// Counts the characters from begin to end by splitting them into chunks of
+// chunk_size bytes that are counted by num_threads threads. The chunks are
+// put into at most groups_per_thread * num_threads groups of neighbouring
+// chunks. Each thread takes the next uncounted group until there are none
+// left, and merges the counts of its chunks as it goes; the group counts are
+// then merged in order. So a tiny chunk size doesn't need a Count for every
+// chunk.
+//
+Count count_chunks(const char *begin, const char *end, long long chunk_size, int num_threads)
+{
+    const long long groups_per_thread = 64;
+
+    const long long size = end - begin;
+    // a chunk bigger than the file is the whole file, and the sums below can't
+    // overflow
+    chunk_size = min(chunk_size, max(1LL, size));
+    const long long num_chunks = (size + chunk_size - 1) / chunk_size;
+    const long long num_groups = min(num_chunks, groups_per_thread * num_threads);
+    vector<Count> group_counts(num_groups);
+    atomic<long long> next_group(0);
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            long long g = next_group++;
+            if (g >= num_groups)
+                return;
+            // group g is chunks first up to last
+            long long first = num_chunks * g / num_groups;
+            long long last = num_chunks * (g + 1) / num_groups;
+            for (long long i = first; i < last; i++)
+            {
+                const char *chunk_begin = begin + i * chunk_size;
+                const char *chunk_end = begin + min(size, (i + 1) * chunk_size);
+                group_counts[g] = merge(group_counts[g], count_chunk(chunk_begin, chunk_end));
+            }
+        }
+    };
+
+    // there's no point in more threads than groups; and if the system won't
+    // start as many threads as asked for, the ones that did start take all
+    // the groups between them
+    vector<thread> workers;
+    for (int t = 0; t < min<long long>(num_threads, num_groups); t++)
+    {
+        try
+        {
+            workers.push_back(thread(worker));
+        }
+        catch (const system_error &)
+        {
+            break;
+        }
+    }
+    if (workers.empty())
+        worker();
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+
+    Count result;
+    for (const Count &c : group_counts)
+    {
+        result = merge(result, c);
+    }
+    return result;
+} // count_chunks
+
+void print(const Count &count)
+{
+    cout << "   #chars: " << count.num_chars << "\n";
+    cout << "   #lines: " << count.num_lines << "\n";
+    cout << "   #tabs : " << count.num_tabs << "\n";
+    cout << "   #words: " << count.num_words << "\n";
+}
+
+// If chunk_size is 0, then the file is split into one chunk per thread.
+void process_file(const string &fname, long long chunk_size, int num_threads)
+{
+    Count count;
+
+    if (fname == "-")
+    {
+        count.add(cin);
+        print(count);
+        return;
+    }
+
+    cmpt::Mapped_file file(fname);
+    if (file.is_open())
+    {
+        if (chunk_size == 0)
+            chunk_size = max<long long>(1, (file.size() + num_threads - 1) / num_threads);
+        count = count_chunks(file.begin(), file.end(), chunk_size, num_threads);
+    }
+    else
+    {
+        // not a regular file, so read it as a stream
+        ifstream infile(fname);
+        count.add(infile);
+    }
+    print(count);
+} // process_file
+
+// Count fname serially, and then in chunks of different sizes, and check that
+// they all agree. Returns true if they do.
+bool check_file(const string &fname, int num_threads)
+{
+    cmpt::Mapped_file file(fname);
+    if (!file.is_open())
+    {
+        cout << fname << ": unable to map file\n";
+        return false;
+    }
+
+    Count serial;
+    serial.add_scalar(file.begin(), file.end());
+
+    bool ok = true;
+    cout << fname << ": chunk sizes";
+    for (long long chunk_size : {1, 2, 3, 7, 16, 31, 32, 33, 4096, 65536, 1000000})
+    {
+        cout << " " << chunk_size;
+        if (!(count_chunks(file.begin(), file.end(), chunk_size, num_threads) == serial))
+        {
+            cout << " (DISAGREES)";
+            ok = false;
+        }
+    }
+    cout << (ok ? " agree\n" : "\n");
+    return ok;
+}
+
+void usage()
+{
+    cout << "Usage: ./count_chars11 [-j num_threads] [-c chunk_size] [--check] file1 [file2 ...]\n";
+    cout << "  -j: number of threads counting each file, up to 1024 (default: number of cores)\n";
+    cout << "  -c: size, in bytes, of each chunk (default: file size / num_threads)\n";
+    cout << "  --check: check that chunked and serial counts agree\n";
+}
+
+// the most threads -j can ask for
+const int max_threads = 1024;
+
+// Converts s to a positive number, or returns 0 if it's not one.
+long long to_positive(const string &s)
+{
+    try
+    {
+        size_t used = 0;
+        long long n = stoll(s, &used);
+        return (used == s.size() && n > 0) ? n : 0;
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_threads = max(1u, thread::hardware_concurrency());
+    long long chunk_size = 0;
+    bool check = false;
+    vector<string> fnames;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-j" || arg == "-c")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            long long n = to_positive(value);
+            if (n == 0 || (arg == "-j" && n > max_threads))
+            {
+                cout << "Invalid value for " << arg << ": \"" << value << "\"\n";
+                usage();
+                return -1;
+            }
+            if (arg == "-j")
+                num_threads = n;
+            else
+                chunk_size = n;
+        }
+        else if (arg == "--check")
+        {
+            check = true;
+        }
+        else
+        {
+            fnames.push_back(arg);
+        }
+    }
+
+    // check that one or more filename arguments provided
+    if (fnames.empty())
+    {
+        cout << "Wrong number of arguments\n";
+        usage();
+        return -1;
+    }
+
+    if (check)
+    {
+        bool all_ok = true;
+        for (const string &fname : fnames)
+        {
+            if (!check_file(fname, num_threads))
+                all_ok = false;
+        }
+        return all_ok ? 0 : 1;
+    }
+
+    for (int i = 0; i < fnames.size(); i++)
+    {
+        if (i > 0)
+            cout << "\n";
+        cout << fnames[i] << ":\n";
+        process_file(fnames[i], chunk_size, num_threads);
+    }
+}
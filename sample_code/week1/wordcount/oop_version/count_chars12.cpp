@@ -0,0 +1,728 @@
+// count_chars12.cpp
+
+//
+// Based on count_chars11. As well as counting characters, lines, tabs and
+// words, this version counts how many times each different word appears, and
+// --top k prints the k most frequent words. Words are separated by the same
+// whitespace characters (' ', '\t' and '\n') as before, and are case-sensitive.
+//
+//   > ./count_chars12 --top 5 austenPride.txt
+//   austenPride.txt:
+//      #chars: 704158
+//      #lines: 13427
+//      #tabs : 0
+//      #words: 124580
+//      #different words: 13644
+//      top 5 words:
+//         4205 the
+//         4121 to
+//         3660 of
+//         3309 and
+//         1945 a
+//
+// The words are counted in a hash table (see Word_table below) that uses open
+// addressing, i.e. all the entries are in one array, and a word that lands on a
+// used entry goes in the next free one after it. The words themselves are
+// copied into one big array of chars, the arena, so there is no separate
+// string for each word. Finding the top k words only partially sorts the
+// table, which is much less work than sorting all of it when k is small.
+//
+// The file is split into one chunk per thread (-j), with each chunk boundary
+// moved forward to the next whitespace character so no word is cut in two.
+// Each thread counts its chunk's words in its own table, so the threads never
+// have to wait for each other, and the tables are merged at the end.
+//
+// --benchmark times the word counting with an unordered_map<string, long long>
+// on one thread, and then with Word_table on 1 thread and on -j threads. For
+// example, on austenPride.txt repeated 100 times:
+//
+//   > for i in $(seq 100); do cat austenPride.txt; done > /tmp/austen100.txt
+//   > ./count_chars12 -j 4 --benchmark /tmp/austen100.txt
+//   /tmp/austen100.txt: 70415800 bytes
+//      unordered_map -j 1: 3.16675s, 13644 different words
+//      Word_table    -j 1: 1.5451s (same counts)
+//      Word_table    -j 4: 1.93153s (same counts)
+//
+// Word_table is about twice as fast as unordered_map on one thread. Those times
+// are from a machine with only 1 core, so -j 4 can only be slower there.
+//
+
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COUNT_X86_SIMD
+#endif
+
+using namespace std;
+
+struct Count
+{
+    long long num_chars = 0;
+    long long num_lines = 0;
+    long long num_tabs = 0;
+    long long num_words = 0;
+
+    // true when the next whitespace character starts a new run of whitespace
+    bool first_whitespace = true;
+
+    // true when the first character counted was whitespace; merge needs this
+    // to tell if a run of whitespace continues from the chunk before
+    bool starts_with_whitespace = false;
+
+    // Update the counts for one character. This is the scalar reference that
+    // the SIMD versions must agree with.
+    void add(char c)
+    {
+        num_chars++;
+        switch (c)
+        {
+        case '\n':
+            num_lines++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case '\t':
+            num_tabs++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case ' ':
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        default:
+            first_whitespace = true;
+        } // switch
+    }
+
+    void add_scalar(const char *begin, const char *end)
+    {
+        for (const char *p = begin; p != end; p++)
+        {
+            add(*p);
+        }
+    }
+
+    //
+    // The SIMD versions compare a block of characters against '\n', '\t', and
+    // ' ' all at once, and turn each comparison into a bit mask with one bit
+    // per character. Counting lines and tabs is then just counting 1 bits.
+    //
+    // A whitespace character starts a new word gap when the character before
+    // it is *not* whitespace. Shifting the whitespace mask left by 1 lines each
+    // character up with the one before it, and the low bit is filled in from
+    // first_whitespace so that runs of whitespace that cross from one block to
+    // the next are only counted once.
+    //
+    void add_block_masks(unsigned newlines, unsigned tabs, unsigned spaces, int block_size)
+    {
+        unsigned whitespace = newlines | tabs | spaces;
+        unsigned before = (whitespace << 1) | (first_whitespace ? 0 : 1);
+
+        num_chars += block_size;
+        num_lines += __builtin_popcount(newlines);
+        num_tabs += __builtin_popcount(tabs);
+        num_words += __builtin_popcount(whitespace & ~before);
+        first_whitespace = ((whitespace >> (block_size - 1)) & 1) == 0;
+    }
+
+#ifdef COUNT_X86_SIMD
+    void add_sse2(const char *begin, const char *end)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i space = _mm_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            add_block_masks(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, space)),
+                            16);
+        }
+        add_scalar(p, end);
+    }
+
+    __attribute__((target("avx2"))) void add_avx2(const char *begin, const char *end)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i space = _mm256_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            add_block_masks(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)),
+                            32);
+        }
+        add_scalar(p, end);
+    }
+#endif
+
+    // Update the counts for all the characters from begin up to, but not
+    // including, end, using the fastest method this CPU supports.
+    void add(const char *begin, const char *end)
+    {
+#ifdef COUNT_X86_SIMD
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2)
+            add_avx2(begin, end);
+        else
+            add_sse2(begin, end);
+#else
+        add_scalar(begin, end);
+#endif
+    }
+
+    // Update the counts for all the characters read from in. The characters
+    // are read in large blocks so the SIMD code can be used.
+    void add(istream &in)
+    {
+        vector<char> buffer(1 << 16);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+        {
+            add(buffer.data(), buffer.data() + in.gcount());
+        }
+    }
+}; // Count
+
+bool operator==(const Count &a, const Count &b)
+{
+    return a.num_chars == b.num_chars && a.num_lines == b.num_lines &&
+           a.num_tabs == b.num_tabs && a.num_words == b.num_words &&
+           a.first_whitespace == b.first_whitespace;
+}
+
+bool is_whitespace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+// Count the characters from begin up to, but not including, end, as if they
+// were a file all by themselves.
+Count count_chunk(const char *begin, const char *end)
+{
+    Count count;
+    if (begin != end)
+        count.starts_with_whitespace = is_whitespace(*begin);
+    count.add(begin, end);
+    return count;
+}
+
+//
+// Returns the counts for chunk a followed immediately by chunk b.
+//
+// Each chunk is counted as if it were the start of a file, and so a chunk that
+// starts with whitespace always counts a word for it. If the chunk before it
+// ended with whitespace, then that whitespace run was already counted by the
+// chunk before, and so one word is subtracted.
+//
+Count merge(const Count &a, const Count &b)
+{
+    if (a.num_chars == 0)
+        return b;
+    if (b.num_chars == 0)
+        return a;
+
+    Count result;
+    result.num_chars = a.num_chars + b.num_chars;
+    result.num_lines = a.num_lines + b.num_lines;
+    result.num_tabs = a.num_tabs + b.num_tabs;
+    result.num_words = a.num_words + b.num_words;
+    if (b.starts_with_whitespace && !a.first_whitespace)
+        result.num_words--;
+    result.first_whitespace = b.first_whitespace;
+    result.starts_with_whitespace = a.starts_with_whitespace;
+    return result;
+}
+
+//
+// Counts the characters from begin to end by splitting them into chunks of
+// chunk_size bytes that are counted by num_threads threads. Each thread takes
+// the next uncounted chunk until there are none left, and the chunk counts are
+// then merged in order.
+//
+Count count_chunks(const char *begin, const char *end, long long chunk_size, int num_threads)
+{
+    const long long size = end - begin;
+    const long long num_chunks = (size + chunk_size - 1) / chunk_size;
+    vector<Count> chunk_counts(num_chunks);
+    atomic<long long> next_chunk(0);
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            long long i = next_chunk++;
+            if (i >= num_chunks)
+                return;
+            const char *chunk_begin = begin + i * chunk_size;
+            const char *chunk_end = begin + min(size, (i + 1) * chunk_size);
+            chunk_counts[i] = count_chunk(chunk_begin, chunk_end);
+        }
+    };
+
+    // there's no point in more threads than chunks; and if the system won't
+    // start as many threads as asked for, the ones that did start take all
+    // the chunks between them
+    vector<thread> workers;
+    for (int t = 0; t < min<long long>(num_threads, num_chunks); t++)
+    {
+        try
+        {
+            workers.push_back(thread(worker));
+        }
+        catch (const system_error &)
+        {
+            break;
+        }
+    }
+    if (workers.empty())
+        worker();
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+
+    Count result;
+    for (const Count &c : chunk_counts)
+    {
+        result = merge(result, c);
+    }
+    return result;
+} // count_chunks
+
+//
+// A hash table that maps words to the number of times they've been seen.
+//
+// It uses open addressing with linear probing: the entries are all in one
+// vector whose size is a power of 2, a word's hash value picks its first
+// entry, and if that entry holds a different word then the following entries
+// are tried in order until the word or an empty entry is found. The table
+// doubles in size when it gets 70% full, so runs of used entries stay short.
+//
+// Each entry stores the word's full hash value, so most different words are
+// told apart without comparing their characters, and growing the table
+// doesn't need to re-hash any words. The characters of the words are kept one
+// after the other in arena, and an entry refers to its word by position.
+//
+class Word_table
+{
+    struct Entry
+    {
+        uint64_t hash = 0;
+        size_t offset = 0; // where the word starts in arena
+        size_t length = 0;
+        long long count = 0; // 0 means the entry is empty
+    };
+
+    vector<Entry> entries;
+    vector<char> arena;
+    size_t num_used = 0;
+
+    // FNV-1a hash
+    static uint64_t hash_of(string_view word)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : word)
+        {
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        return h;
+    }
+
+    string_view word_of(const Entry &e) const
+    {
+        return string_view(arena.data() + e.offset, e.length);
+    }
+
+    void grow()
+    {
+        vector<Entry> old_entries(2 * entries.size());
+        swap(entries, old_entries);
+        const size_t mask = entries.size() - 1;
+        for (const Entry &e : old_entries)
+        {
+            if (e.count == 0)
+                continue;
+            size_t i = e.hash & mask;
+            while (entries[i].count != 0)
+                i = (i + 1) & mask;
+            entries[i] = e;
+        }
+    }
+
+    void add(string_view word, uint64_t hash, long long count)
+    {
+        const size_t mask = entries.size() - 1;
+        size_t i = hash & mask;
+        for (; entries[i].count != 0; i = (i + 1) & mask)
+        {
+            Entry &e = entries[i];
+            if (e.hash == hash && e.length == word.size() &&
+                memcmp(arena.data() + e.offset, word.data(), word.size()) == 0)
+            {
+                e.count += count;
+                return;
+            }
+        }
+
+        // a new word
+        entries[i] = Entry{hash, arena.size(), word.size(), count};
+        arena.insert(arena.end(), word.begin(), word.end());
+        num_used++;
+        if (10 * num_used > 7 * entries.size())
+            grow();
+    }
+
+public:
+    Word_table()
+        : entries(1024)
+    {
+    }
+
+    // Adds count to the number of times word has been seen.
+    void add(string_view word, long long count = 1)
+    {
+        add(word, hash_of(word), count);
+    }
+
+    // Adds all the words and counts in other to this table.
+    void merge(const Word_table &other)
+    {
+        for (const Entry &e : other.entries)
+        {
+            if (e.count != 0)
+                add(other.word_of(e), e.hash, e.count);
+        }
+    }
+
+    // the number of different words
+    size_t size() const { return num_used; }
+
+    // Returns all the words and their counts, in no particular order.
+    vector<pair<string_view, long long>> words() const
+    {
+        vector<pair<string_view, long long>> result;
+        result.reserve(num_used);
+        for (const Entry &e : entries)
+        {
+            if (e.count != 0)
+                result.push_back({word_of(e), e.count});
+        }
+        return result;
+    }
+}; // class Word_table
+
+// Calls f(word) for each word from begin to end.
+template <class Word_fn>
+void for_each_word(const char *begin, const char *end, Word_fn f)
+{
+    const char *p = begin;
+    while (p != end)
+    {
+        while (p != end && is_whitespace(*p))
+            p++;
+        const char *start = p;
+        while (p != end && !is_whitespace(*p))
+            p++;
+        if (p != start)
+            f(string_view(start, p - start));
+    }
+}
+
+//
+// Counts the words from begin to end on num_threads threads. The characters
+// are split into one chunk per thread, and each chunk boundary is moved
+// forward past any non-whitespace so that no word is split between two
+// chunks. Each thread counts into its own table, and then the tables are
+// merged into the first one. Chunks are at least min_chunk_size bytes, so a
+// small file isn't split between more threads (and tables) than is useful.
+//
+Word_table count_words(const char *begin, const char *end, int num_threads)
+{
+    const long long min_chunk_size = 1 << 16;
+    num_threads = max(1LL, min<long long>(num_threads, (end - begin) / min_chunk_size));
+
+    vector<const char *> boundaries = {begin};
+    for (int t = 1; t < num_threads; t++)
+    {
+        const char *p = max(boundaries.back(), begin + (end - begin) * t / num_threads);
+        while (p != end && !is_whitespace(*p))
+            p++;
+        boundaries.push_back(p);
+    }
+    boundaries.push_back(end);
+
+    vector<Word_table> tables(num_threads);
+    auto count_chunk = [&](int t)
+    { for_each_word(boundaries[t], boundaries[t + 1], [&](string_view w) { tables[t].add(w); }); };
+
+    // if the system won't start a thread, its chunk is counted here instead
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++)
+    {
+        try
+        {
+            workers.push_back(thread(count_chunk, t));
+        }
+        catch (const system_error &)
+        {
+            count_chunk(t);
+        }
+    }
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+
+    for (int t = 1; t < num_threads; t++)
+    {
+        tables[0].merge(tables[t]);
+    }
+    return move(tables[0]);
+} // count_words
+
+// Returns the k most frequent words, most frequent first. Words with the same
+// count are in alphabetical order. Only the first k words are sorted.
+vector<pair<string_view, long long>> top_words(const Word_table &table, int k)
+{
+    vector<pair<string_view, long long>> words = table.words();
+    auto more_frequent = [](const pair<string_view, long long> &a,
+                            const pair<string_view, long long> &b)
+    {
+        if (a.second != b.second)
+            return a.second > b.second;
+        return a.first < b.first;
+    };
+    k = min<size_t>(k, words.size());
+    partial_sort(words.begin(), words.begin() + k, words.end(), more_frequent);
+    words.resize(k);
+    return words;
+}
+
+void print(const Count &count)
+{
+    cout << "   #chars: " << count.num_chars << "\n";
+    cout << "   #lines: " << count.num_lines << "\n";
+    cout << "   #tabs : " << count.num_tabs << "\n";
+    cout << "   #words: " << count.num_words << "\n";
+}
+
+void print_top(const Word_table &table, int k)
+{
+    cout << "   #different words: " << table.size() << "\n";
+    cout << "   top " << k << " words:\n";
+    for (const auto &[word, count] : top_words(table, k))
+    {
+        cout << "      " << count << " " << word << "\n";
+    }
+}
+
+// Counts the characters read from in. The words can only be counted once all
+// of in has been read into memory, so that's done only if top is more than 0;
+// otherwise in is streamed through Count::add in blocks.
+void process_stream(istream &in, int top)
+{
+    Count count;
+    if (top == 0)
+    {
+        count.add(in);
+        print(count);
+        return;
+    }
+
+    string contents(istreambuf_iterator<char>(in), {});
+    count.add(contents.data(), contents.data() + contents.size());
+    print(count);
+    print_top(count_words(contents.data(), contents.data() + contents.size(), 1), top);
+} // process_stream
+
+// If top is more than 0, then the top most frequent words are printed too.
+void process_file(const string &fname, int top, int num_threads)
+{
+    if (fname == "-")
+    {
+        process_stream(cin, top);
+        return;
+    }
+
+    cmpt::Mapped_file file(fname);
+    if (file.is_open())
+    {
+        const long long chunk_size = max<long long>(1, (file.size() + num_threads - 1) / num_threads);
+        print(count_chunks(file.begin(), file.end(), chunk_size, num_threads));
+        if (top > 0)
+            print_top(count_words(file.begin(), file.end(), num_threads), top);
+    }
+    else
+    {
+        // not a regular file, so read it as a stream
+        ifstream infile(fname);
+        process_stream(infile, top);
+    }
+} // process_file
+
+//
+// Times counting the words of fname with unordered_map on one thread, and with
+// Word_table on 1 and num_threads threads, and checks that the top 100 words
+// are the same each time.
+//
+bool benchmark(const string &fname, int num_threads)
+{
+    cmpt::Mapped_file file(fname);
+    if (!file.is_open())
+    {
+        cout << fname << ": unable to map file\n";
+        return false;
+    }
+    cout << fname << ": " << file.size() << " bytes\n";
+
+    // unordered_map, the standard way
+    auto start = chrono::steady_clock::now();
+    unordered_map<string, long long> map_counts;
+    for_each_word(file.begin(), file.end(), [&](string_view w) { map_counts[string(w)]++; });
+    Word_table expected;
+    for (const auto &[word, count] : map_counts)
+    {
+        expected.add(word, count);
+    }
+    vector<pair<string_view, long long>> expected_top = top_words(expected, 100);
+    auto end = chrono::steady_clock::now();
+    cout << "   unordered_map -j 1: " << chrono::duration<double>(end - start).count() << "s, "
+         << map_counts.size() << " different words\n";
+
+    vector<int> thread_counts = {1};
+    if (num_threads > 1)
+        thread_counts.push_back(num_threads);
+
+    bool ok = true;
+    for (int n : thread_counts)
+    {
+        start = chrono::steady_clock::now();
+        Word_table table = count_words(file.begin(), file.end(), n);
+        vector<pair<string_view, long long>> top = top_words(table, 100);
+        end = chrono::steady_clock::now();
+
+        bool same = (table.size() == map_counts.size() && top == expected_top);
+        if (!same)
+            ok = false;
+        cout << "   Word_table    -j " << n << ": " << chrono::duration<double>(end - start).count()
+             << "s" << (same ? " (same counts)" : " (DIFFERENT COUNTS)") << "\n";
+    }
+    return ok;
+} // benchmark
+
+void usage()
+{
+    cout << "Usage: ./count_chars12 [-j num_threads] [--top k] [--benchmark] file1 [file2 ...]\n";
+    cout << "  -j: number of threads counting each file, up to 1024 (default: number of cores)\n";
+    cout << "  --top: also print the k most frequent words\n";
+    cout << "  --benchmark: time counting word frequencies different ways\n";
+}
+
+// the most threads -j can ask for
+const int max_threads = 1024;
+
+// Converts s to a positive number, or returns 0 if it's not one.
+long long to_positive(const string &s)
+{
+    try
+    {
+        size_t used = 0;
+        long long n = stoll(s, &used);
+        return (used == s.size() && n > 0) ? n : 0;
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int num_threads = max(1u, thread::hardware_concurrency());
+    int top = 0;
+    bool run_benchmark = false;
+    vector<string> fnames;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-j" || arg == "--top")
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            long long n = to_positive(value);
+            if (n == 0 || n > (arg == "-j" ? max_threads : 1000000))
+            {
+                cout << "Invalid value for " << arg << ": \"" << value << "\"\n";
+                usage();
+                return -1;
+            }
+            if (arg == "-j")
+                num_threads = n;
+            else
+                top = n;
+        }
+        else if (arg == "--benchmark")
+        {
+            run_benchmark = true;
+        }
+        else
+        {
+            fnames.push_back(arg);
+        }
+    }
+
+    // check that one or more filename arguments provided
+    if (fnames.empty())
+    {
+        cout << "Wrong number of arguments\n";
+        usage();
+        return -1;
+    }
+
+    if (run_benchmark)
+    {
+        bool all_ok = true;
+        for (const string &fname : fnames)
+        {
+            if (!benchmark(fname, num_threads))
+                all_ok = false;
+        }
+        return all_ok ? 0 : 1;
+    }
+
+    for (int i = 0; i < fnames.size(); i++)
+    {
+        if (i > 0)
+            cout << "\n";
+        cout << fnames[i] << ":\n";
+        process_file(fnames[i], top, num_threads);
+    }
+}
@@ -0,0 +1,140 @@
+// count_chars8.cpp
+
+//
+// Based on count_chars7. Regular files are read using a memory-mapped file
+// (see cmpt_mapped_file.h), which is much faster than calling get() once for
+// every character. Anything that can't be mapped, such as a pipe, is read with
+// an fstream just like before. The file name - means read from cin.
+//
+//   > ./count_chars8 austenPride.txt
+//   austenPride.txt:
+//      #chars: 704158
+//      #lines: 13427
+//      #tabs : 0
+//      #words: 124580
+//
+//   > cat austenPride.txt | ./count_chars8 -
+//   -:
+//      #chars: 704158
+//      #lines: 13427
+//      #tabs : 0
+//      #words: 124580
+//
+
+#include "cmpt_mapped_file.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+struct Count
+{
+    // long long is used so that files bigger than 2GB are counted correctly
+    long long num_chars = 0;
+    long long num_lines = 0;
+    long long num_tabs = 0;
+    long long num_words = 0;
+
+    // true when the next whitespace character starts a new run of whitespace
+    bool first_whitespace = true;
+
+    // Update the counts for one character.
+    void add(char c)
+    {
+        num_chars++;
+        switch (c)
+        {
+        case '\n':
+            num_lines++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case '\t':
+            num_tabs++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case ' ':
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        default:
+            first_whitespace = true;
+        } // switch
+    }
+
+    // Update the counts for all the characters from begin up to, but not
+    // including, end.
+    void add(const char *begin, const char *end)
+    {
+        for (const char *p = begin; p != end; p++)
+        {
+            add(*p);
+        }
+    }
+
+    // Update the counts for all the characters read from in.
+    void add(istream &in)
+    {
+        char c;
+        while (in.get(c))
+        {
+            add(c);
+        }
+    }
+}; // Count
+
+void print(const Count &count)
+{
+    cout << "   #chars: " << count.num_chars << "\n";
+    cout << "   #lines: " << count.num_lines << "\n";
+    cout << "   #tabs : " << count.num_tabs << "\n";
+    cout << "   #words: " << count.num_words << "\n";
+}
+
+void process_file(const string &fname)
+{
+    Count count;
+
+    if (fname == "-")
+    {
+        count.add(cin);
+        print(count);
+        return;
+    }
+
+    cmpt::Mapped_file file(fname);
+    if (file.is_open())
+    {
+        count.add(file.begin(), file.end());
+    }
+    else
+    {
+        // not a regular file, so read it as a stream
+        ifstream infile(fname);
+        count.add(infile);
+    }
+    print(count);
+} // process_file
+
+int main(int argc, char *argv[])
+{
+    // check that one or more filename arguments provided
+    if (argc < 2)
+    {
+        cout << "Wrong number of arguments\n";
+        return -1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i > 1)
+            cout << "\n";
+        cout << argv[i] << ":\n";
+        process_file(argv[i]);
+    }
+}
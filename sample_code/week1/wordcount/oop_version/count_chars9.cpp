@@ -0,0 +1,298 @@
+// count_chars9.cpp
+
+//
+// Based on count_chars8. The switch statement that looks at one character at a
+// time is replaced by SIMD code that looks at 16 (SSE2) or 32 (AVX2)
+// characters at a time. The original switch is kept as the scalar reference,
+// and is used for the last few characters of a file and on CPUs without SIMD.
+//
+//   > ./count_chars9 austenPride.txt
+//   austenPride.txt:
+//      #chars: 704158
+//      #lines: 13427
+//      #tabs : 0
+//      #words: 124580
+//
+// The --check option counts each file with every available method and checks
+// that they all get the same answer:
+//
+//   > ./count_chars9 --check austenPride.txt ../../../../assignments/a1/tiny_shakespeare.txt
+//   austenPride.txt: scalar, sse2, avx2, split agree
+//   ../../../../assignments/a1/tiny_shakespeare.txt: scalar, sse2, avx2, split agree
+//
+
+#include "cmpt_mapped_file.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COUNT_X86_SIMD
+#endif
+
+using namespace std;
+
+struct Count
+{
+    long long num_chars = 0;
+    long long num_lines = 0;
+    long long num_tabs = 0;
+    long long num_words = 0;
+
+    // true when the next whitespace character starts a new run of whitespace
+    bool first_whitespace = true;
+
+    // Update the counts for one character. This is the scalar reference that
+    // the SIMD versions must agree with.
+    void add(char c)
+    {
+        num_chars++;
+        switch (c)
+        {
+        case '\n':
+            num_lines++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case '\t':
+            num_tabs++;
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        case ' ':
+            if (first_whitespace)
+                num_words++;
+            first_whitespace = false;
+            break;
+        default:
+            first_whitespace = true;
+        } // switch
+    }
+
+    void add_scalar(const char *begin, const char *end)
+    {
+        for (const char *p = begin; p != end; p++)
+        {
+            add(*p);
+        }
+    }
+
+    //
+    // The SIMD versions compare a block of characters against '\n', '\t', and
+    // ' ' all at once, and turn each comparison into a bit mask with one bit
+    // per character. Counting lines and tabs is then just counting 1 bits.
+    //
+    // A whitespace character starts a new word gap when the character before
+    // it is *not* whitespace. Shifting the whitespace mask left by 1 lines each
+    // character up with the one before it, and the low bit is filled in from
+    // first_whitespace so that runs of whitespace that cross from one block to
+    // the next are only counted once.
+    //
+    void add_block_masks(unsigned newlines, unsigned tabs, unsigned spaces, int block_size)
+    {
+        unsigned whitespace = newlines | tabs | spaces;
+        unsigned before = (whitespace << 1) | (first_whitespace ? 0 : 1);
+
+        num_chars += block_size;
+        num_lines += __builtin_popcount(newlines);
+        num_tabs += __builtin_popcount(tabs);
+        num_words += __builtin_popcount(whitespace & ~before);
+        first_whitespace = ((whitespace >> (block_size - 1)) & 1) == 0;
+    }
+
+#ifdef COUNT_X86_SIMD
+    void add_sse2(const char *begin, const char *end)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i space = _mm_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            add_block_masks(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, tab)),
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(block, space)),
+                            16);
+        }
+        add_scalar(p, end);
+    }
+
+    __attribute__((target("avx2"))) void add_avx2(const char *begin, const char *end)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i space = _mm256_set1_epi8(' ');
+
+        const char *p = begin;
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            add_block_masks(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab)),
+                            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)),
+                            32);
+        }
+        add_scalar(p, end);
+    }
+#endif
+
+    // Update the counts for all the characters from begin up to, but not
+    // including, end, using the fastest method this CPU supports.
+    void add(const char *begin, const char *end)
+    {
+#ifdef COUNT_X86_SIMD
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2)
+            add_avx2(begin, end);
+        else
+            add_sse2(begin, end);
+#else
+        add_scalar(begin, end);
+#endif
+    }
+
+    // Update the counts for all the characters read from in. The characters
+    // are read in large blocks so the SIMD code can be used.
+    void add(istream &in)
+    {
+        vector<char> buffer(1 << 16);
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+        {
+            add(buffer.data(), buffer.data() + in.gcount());
+        }
+    }
+}; // Count
+
+bool operator==(const Count &a, const Count &b)
+{
+    return a.num_chars == b.num_chars && a.num_lines == b.num_lines &&
+           a.num_tabs == b.num_tabs && a.num_words == b.num_words &&
+           a.first_whitespace == b.first_whitespace;
+}
+
+void print(const Count &count)
+{
+    cout << "   #chars: " << count.num_chars << "\n";
+    cout << "   #lines: " << count.num_lines << "\n";
+    cout << "   #tabs : " << count.num_tabs << "\n";
+    cout << "   #words: " << count.num_words << "\n";
+}
+
+void process_file(const string &fname)
+{
+    Count count;
+
+    if (fname == "-")
+    {
+        count.add(cin);
+        print(count);
+        return;
+    }
+
+    cmpt::Mapped_file file(fname);
+    if (file.is_open())
+    {
+        count.add(file.begin(), file.end());
+    }
+    else
+    {
+        // not a regular file, so read it as a stream
+        ifstream infile(fname);
+        count.add(infile);
+    }
+    print(count);
+} // process_file
+
+//
+// Count fname with the scalar reference and with each SIMD version, and check
+// they agree. The "split" test feeds the file to add() in small odd-sized
+// pieces so that lots of whitespace runs cross from one piece to the next.
+// Returns true if everything agrees.
+//
+bool check_file(const string &fname)
+{
+    cmpt::Mapped_file file(fname);
+    if (!file.is_open())
+    {
+        cout << fname << ": unable to map file\n";
+        return false;
+    }
+
+    Count reference;
+    reference.add_scalar(file.begin(), file.end());
+
+    vector<string> names;
+    vector<Count> counts;
+
+#ifdef COUNT_X86_SIMD
+    Count sse2;
+    sse2.add_sse2(file.begin(), file.end());
+    names.push_back("sse2");
+    counts.push_back(sse2);
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        Count avx2;
+        avx2.add_avx2(file.begin(), file.end());
+        names.push_back("avx2");
+        counts.push_back(avx2);
+    }
+#endif
+
+    Count split;
+    const int piece_size = 37;
+    for (const char *p = file.begin(); p != file.end();)
+    {
+        const char *piece_end = p + min<size_t>(piece_size, file.end() - p);
+        split.add(p, piece_end);
+        p = piece_end;
+    }
+    names.push_back("split");
+    counts.push_back(split);
+
+    bool ok = true;
+    cout << fname << ": scalar";
+    for (int i = 0; i < names.size(); i++)
+    {
+        cout << ", " << names[i];
+        if (!(counts[i] == reference))
+            ok = false;
+    }
+    cout << (ok ? " agree\n" : " DISAGREE\n");
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    // check that one or more filename arguments provided
+    if (argc < 2)
+    {
+        cout << "Wrong number of arguments\n";
+        return -1;
+    }
+
+    if (string(argv[1]) == "--check")
+    {
+        bool all_ok = true;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!check_file(argv[i]))
+                all_ok = false;
+        }
+        return all_ok ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i > 1)
+            cout << "\n";
+        cout << argv[i] << ":\n";
+        process_file(argv[i]);
+    }
+}
@@ -0,0 +1,968 @@
+// word_index.cpp
+
+//
+// Builds an inverted index of one or more text files, and uses it to find the
+// paragraphs that contain all of a list of words or phrases. The index is saved
+// to a file, and searching memory-maps that file (see cmpt_mapped_file.h), so
+// nothing has to be read or rebuilt before the first query:
+//
+//   > ./word_index build -o austen.idx austenPride.txt
+//   indexed 704158 bytes (126063 words, 2184 paragraphs) from 1 file in 0.113977s:
+//   6.17807 MB/s, 1.10604 M words/s
+//   wrote austen.idx: 6612 different words, 827033 bytes (495665 bytes of postings)
+//
+//   > ./word_index query -k 3 austen.idx 'darcy pemberley' '"my dear mr bennet"'
+//   opened austen.idx in 27.639 us
+//   darcy pemberley: 20 paragraphs (52.431 us)
+//     austenPride.txt:1285
+//     austenPride.txt:1308
+//     austenPride.txt:2822
+//   "my dear mr bennet": 6 paragraphs (51.344 us)
+//     austenPride.txt:49
+//     austenPride.txt:83
+//     austenPride.txt:237
+//   2 queries: 51.8875 us average
+//
+//   ./word_index build [-o index_file] file1 [file2 ...]
+//   ./word_index query [-k num_shown] index_file [query ...]
+//
+// The default index file is word_index.idx. Files that can't be memory-mapped,
+// such as pipes, are read into memory instead. With no queries on the command
+// line, each line read from cin is a query.
+//
+// A query is a list of words and phrases in double quotes, and it matches the
+// paragraphs that contain all of them. Each match is shown as the file and line
+// number where the paragraph starts, and -k sets how many are shown (the
+// default is 10). Paragraphs are separated by lines with no words on them.
+// Words are runs of letters and digits (and any non-ASCII bytes), and case is
+// ignored, so "Darcy's" is the two words darcy and s.
+//
+// Building reports how fast the files were indexed, and each query reports how
+// long it took, not counting printing; opening the index is timed too.
+//
+// The Index
+// ---------
+// For each different word, the index has a posting list: the number of each
+// paragraph (or document) it's in, and the positions of the word in that
+// paragraph, so phrases can be checked. Document numbers only go up, so each
+// one is saved as the difference from the one before (a "delta"), and the
+// positions are too. The deltas are mostly small, and are written as varints:
+// 7 bits per byte, with the top bit set on every byte but the last. So most
+// deltas take one byte instead of four.
+//
+// Varints can only be read in order, so each list is split into blocks of
+// block_size documents, and a skip table has the last document in each block
+// and where the block starts. To find the first document >= d in a list,
+// galloping search checks blocks 1, 2, 4, 8, ... ahead in the skip table until
+// it passes d, then binary searches the blocks in between, and decodes just
+// that one block. Intersecting lists starts with the shortest one and uses
+// this to skip through the others, so the time depends mostly on the shortest
+// list.
+//
+// All the numbers in the file are fixed-size and aligned, so the mapped file
+// is used as it is: the word table is sorted, and is binary searched in place.
+//
+// Most of the index is positions: every word in the text has one, so the
+// posting lists are about 70% of the size of austenPride.txt itself, and a
+// query for a common word like "the" has to decode a lot of them. A query's
+// time grows with the number of paragraphs it matches, since each one has to
+// be collected.
+//
+
+#include "cmpt_mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// the number of documents in each block of a posting list
+const uint32_t block_size = 128;
+
+//
+// The index file: a header, then the tables below, each starting at a multiple
+// of 8 bytes. Offsets are from the start of the file.
+//
+struct Index_header
+{
+    char magic[8]; // "WORDIDX1"
+    uint64_t num_files;
+    uint64_t num_docs;
+    uint64_t num_words;
+    uint64_t files_offset;    // num_files File_entry
+    uint64_t docs_offset;     // num_docs Doc_entry
+    uint64_t words_offset;    // num_words Word_entry, sorted by word
+    uint64_t strings_offset;  // the file names and words
+    uint64_t postings_offset; // the posting lists
+    uint64_t file_size;
+};
+
+const char index_magic[8] = {'W', 'O', 'R', 'D', 'I', 'D', 'X', '1'};
+
+struct File_entry
+{
+    uint64_t name_offset; // from strings_offset
+    uint64_t name_length;
+};
+
+// a document is a paragraph
+struct Doc_entry
+{
+    uint32_t file;
+    uint32_t line; // the paragraph's first line, counting from 1
+};
+
+//
+// A word's posting list is its skip table (num_blocks Skip entries) followed
+// by the blocks. In a block, each document is written as:
+//
+//   varint  document - previous document (for the first document in a block,
+//           the previous one is the last one of the block before, or 0)
+//   varint  the number of positions
+//   varint  the number of bytes the positions take
+//   varint  the positions, each minus the one before (the first is as is)
+//
+// Saving the size of the positions lets a search skip over them.
+//
+struct Word_entry
+{
+    uint64_t name_offset; // from strings_offset
+    uint32_t name_length;
+    uint32_t num_docs;
+    uint64_t num_occurrences;
+    uint64_t postings_offset; // from postings_offset
+    uint32_t num_blocks;
+    uint32_t unused;
+};
+
+struct Skip
+{
+    uint32_t last_doc;
+    uint32_t offset; // from the end of the skip table
+};
+
+void write_varint(vector<uint8_t> &out, uint32_t n)
+{
+    while (n >= 0x80)
+    {
+        out.push_back((n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    out.push_back(n);
+}
+
+uint32_t read_varint(const uint8_t *&p)
+{
+    uint32_t n = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        uint8_t b = *p++;
+        n |= uint32_t(b & 0x7f) << shift;
+        if (b < 0x80)
+            return n;
+    }
+}
+
+// Words are made of letters, digits, and bytes of non-ASCII UTF-8 characters.
+bool is_word_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           static_cast<unsigned char>(c) >= 0x80;
+}
+
+char to_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Calls f(word, line) for each word in text, lowercased, with the number of
+// the line it's on (counting from 1), and f("", line) at the end of each line
+// that has no words on it.
+template <class Fn>
+void for_each_word(const char *begin, const char *end, Fn f)
+{
+    string word;
+    uint32_t line = 1;
+    bool line_has_words = false;
+    for (const char *p = begin; p != end;)
+    {
+        if (is_word_char(*p))
+        {
+            word.clear();
+            while (p != end && is_word_char(*p))
+                word += to_lower(*p++);
+            f(word, line);
+            line_has_words = true;
+        }
+        else
+        {
+            if (*p == '\n')
+            {
+                if (!line_has_words)
+                    f(string(), line);
+                line++;
+                line_has_words = false;
+            }
+            p++;
+        }
+    }
+}
+
+// Returns the words of s, as they're found in the index.
+vector<string> words_of(string_view s)
+{
+    vector<string> words;
+    for_each_word(s.data(), s.data() + s.size(), [&](const string &w, uint32_t)
+                  {
+        if (!w.empty())
+            words.push_back(w); });
+    return words;
+}
+
+// Rounds n up to a multiple of 8.
+uint64_t align8(uint64_t n)
+{
+    return (n + 7) / 8 * 8;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Building an index
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// A word's posting list while it's being built. The positions of the word in
+// the current document are collected, and the document is encoded when it
+// ends.
+//
+struct Word_builder
+{
+    vector<uint8_t> bytes;
+    vector<Skip> skips;
+    uint32_t num_docs = 0;
+    uint64_t num_occurrences = 0;
+    uint32_t last_doc = 0;
+    uint32_t block_start = 0;
+    uint32_t num_in_block = 0;
+    vector<uint32_t> positions; // in the current document
+
+    void add_doc(uint32_t doc, vector<uint8_t> &scratch)
+    {
+        if (num_in_block == 0)
+            block_start = bytes.size();
+        const uint32_t previous = (num_docs == 0) ? 0 : last_doc;
+        write_varint(bytes, doc - previous);
+
+        scratch.clear();
+        uint32_t previous_position = 0;
+        for (uint32_t p : positions)
+        {
+            write_varint(scratch, p - previous_position);
+            previous_position = p;
+        }
+        write_varint(bytes, positions.size());
+        write_varint(bytes, scratch.size());
+        bytes.insert(bytes.end(), scratch.begin(), scratch.end());
+
+        num_occurrences += positions.size();
+        positions.clear();
+        last_doc = doc;
+        num_docs++;
+        if (++num_in_block == block_size)
+            finish_block();
+    }
+
+    void finish_block()
+    {
+        if (num_in_block > 0)
+            skips.push_back(Skip{last_doc, block_start});
+        num_in_block = 0;
+    }
+}; // struct Word_builder
+
+class Index_builder
+{
+    vector<string> fnames;
+    vector<Doc_entry> docs;
+    unordered_map<string, uint32_t> word_ids;
+    vector<string> words;
+    vector<Word_builder> postings;
+    vector<uint32_t> words_in_doc; // ids of the words in the current document
+    uint32_t position = 0;         // of the next word in the current document
+    vector<uint8_t> scratch;
+
+    void end_doc()
+    {
+        for (uint32_t id : words_in_doc)
+        {
+            postings[id].add_doc(docs.size() - 1, scratch);
+        }
+        words_in_doc.clear();
+        position = 0;
+    }
+
+public:
+    long long num_bytes = 0;
+    long long num_words = 0;
+
+    void add_file(const string &fname, const char *begin, const char *end)
+    {
+        fnames.push_back(fname);
+        num_bytes += end - begin;
+        bool in_doc = false;
+        for_each_word(begin, end, [&](const string &word, uint32_t line)
+                      {
+            if (word.empty())
+            {
+                // a line with no words ends the paragraph
+                if (in_doc)
+                    end_doc();
+                in_doc = false;
+                return;
+            }
+            if (!in_doc)
+            {
+                docs.push_back(Doc_entry{uint32_t(fnames.size() - 1), line});
+                in_doc = true;
+            }
+
+            auto it = word_ids.find(word);
+            if (it == word_ids.end())
+            {
+                it = word_ids.emplace(word, words.size()).first;
+                words.push_back(word);
+                postings.emplace_back();
+            }
+            Word_builder &w = postings[it->second];
+            if (w.positions.empty())
+                words_in_doc.push_back(it->second);
+            w.positions.push_back(position++);
+            num_words++; });
+        if (in_doc)
+            end_doc();
+    }
+
+    size_t num_docs() const { return docs.size(); }
+    size_t num_different_words() const { return words.size(); }
+
+    //
+    // Writes the index to fname. Returns false if it can't be written, and
+    // otherwise sets file_size and postings_size to the number of bytes in the
+    // file and in its posting lists.
+    //
+    bool write(const string &fname, uint64_t &file_size, uint64_t &postings_size)
+    {
+        vector<uint32_t> order(words.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+             { return words[a] < words[b]; });
+
+        string strings;
+        vector<File_entry> files;
+        for (const string &name : fnames)
+        {
+            files.push_back(File_entry{strings.size(), name.size()});
+            strings += name;
+        }
+
+        // each posting list starts at a multiple of 4 bytes, so its skip
+        // table is aligned
+        vector<Word_entry> entries;
+        vector<uint8_t> lists;
+        for (uint32_t id : order)
+        {
+            Word_builder &w = postings[id];
+            w.finish_block();
+            lists.resize((lists.size() + 3) / 4 * 4);
+            entries.push_back(Word_entry{strings.size(), uint32_t(words[id].size()), w.num_docs,
+                                         w.num_occurrences, lists.size(), uint32_t(w.skips.size()), 0});
+            strings += words[id];
+            const uint8_t *skips = reinterpret_cast<const uint8_t *>(w.skips.data());
+            lists.insert(lists.end(), skips, skips + w.skips.size() * sizeof(Skip));
+            lists.insert(lists.end(), w.bytes.begin(), w.bytes.end());
+        }
+
+        Index_header h;
+        memcpy(h.magic, index_magic, sizeof(h.magic));
+        h.num_files = files.size();
+        h.num_docs = docs.size();
+        h.num_words = entries.size();
+        h.files_offset = align8(sizeof(h));
+        h.docs_offset = align8(h.files_offset + files.size() * sizeof(File_entry));
+        h.words_offset = align8(h.docs_offset + docs.size() * sizeof(Doc_entry));
+        h.strings_offset = align8(h.words_offset + entries.size() * sizeof(Word_entry));
+        h.postings_offset = align8(h.strings_offset + strings.size());
+        h.file_size = h.postings_offset + lists.size();
+
+        ofstream out(fname, ios::binary);
+        auto write_at = [&](uint64_t offset, const void *data, size_t size)
+        {
+            static const char zeros[8] = {};
+            out.write(zeros, offset - out.tellp());
+            out.write(static_cast<const char *>(data), size);
+        };
+        write_at(0, &h, sizeof(h));
+        write_at(h.files_offset, files.data(), files.size() * sizeof(File_entry));
+        write_at(h.docs_offset, docs.data(), docs.size() * sizeof(Doc_entry));
+        write_at(h.words_offset, entries.data(), entries.size() * sizeof(Word_entry));
+        write_at(h.strings_offset, strings.data(), strings.size());
+        write_at(h.postings_offset, lists.data(), lists.size());
+        out.close();
+
+        file_size = h.file_size;
+        postings_size = lists.size();
+        return bool(out);
+    } // write
+}; // class Index_builder
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Searching an index
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// An index file, memory-mapped. The tables point straight into the mapping.
+//
+// A damaged index file mustn't make a query read outside the mapping. So
+// opening it checks that every table is inside the file, and the parts that
+// are only read during a query (names, documents, and posting lists) are
+// checked as they are used; if one is bad, a runtime_error is thrown.
+//
+class Word_index
+{
+    cmpt::Mapped_file file;
+    const Index_header *header = nullptr;
+    const File_entry *files = nullptr;
+    const Doc_entry *docs = nullptr;
+    const Word_entry *words = nullptr;
+    const char *strings = nullptr;
+
+public:
+    const uint8_t *postings = nullptr;
+
+    // Opens the index in fname. If it isn't a valid index, error is set to
+    // say why.
+    Word_index(const string &fname, string &error)
+        : file(fname)
+    {
+        if (!file.is_open())
+        {
+            error = "unable to map file \"" + fname + "\"";
+            return;
+        }
+        header = reinterpret_cast<const Index_header *>(file.begin());
+        if (file.size() < sizeof(Index_header) || memcmp(header->magic, index_magic, 8) != 0 ||
+            header->file_size != file.size())
+        {
+            error = "\"" + fname + "\" is not a word index";
+            header = nullptr;
+            return;
+        }
+
+        // count entries of entry_size bytes starting at offset must be in the
+        // file, and start at a multiple of 8 bytes
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t entry_size)
+        {
+            return offset % 8 == 0 && offset <= file.size() &&
+                   count <= (file.size() - offset) / entry_size;
+        };
+        if (!fits(header->files_offset, header->num_files, sizeof(File_entry)) ||
+            !fits(header->docs_offset, header->num_docs, sizeof(Doc_entry)) ||
+            !fits(header->words_offset, header->num_words, sizeof(Word_entry)) ||
+            header->strings_offset > header->postings_offset ||
+            !fits(header->postings_offset, 0, 1) || header->num_docs > UINT32_MAX)
+        {
+            error = "\"" + fname + "\" is damaged: its tables aren't all inside the file";
+            header = nullptr;
+            return;
+        }
+        files = reinterpret_cast<const File_entry *>(file.begin() + header->files_offset);
+        docs = reinterpret_cast<const Doc_entry *>(file.begin() + header->docs_offset);
+        words = reinterpret_cast<const Word_entry *>(file.begin() + header->words_offset);
+        strings = file.begin() + header->strings_offset;
+        postings = reinterpret_cast<const uint8_t *>(file.begin() + header->postings_offset);
+    }
+
+    bool is_open() const { return header != nullptr; }
+
+    // The name of a file or a word.
+    template <class Entry>
+    string_view name(const Entry &e) const
+    {
+        const uint64_t strings_size = header->postings_offset - header->strings_offset;
+        if (e.name_offset > strings_size || e.name_length > strings_size - e.name_offset)
+            throw runtime_error("the index is damaged: a name is outside the file");
+        return string_view(strings + e.name_offset, e.name_length);
+    }
+
+    // The size of the posting lists, from postings to the end of the file.
+    uint64_t postings_size() const { return file.size() - header->postings_offset; }
+
+    // Returns the entry for word, or nullptr if it isn't in the index.
+    const Word_entry *find(string_view word) const
+    {
+        const Word_entry *end = words + header->num_words;
+        const Word_entry *w = lower_bound(words, end, word, [&](const Word_entry &e, string_view x)
+                                          { return name(e) < x; });
+        return (w != end && name(*w) == word) ? w : nullptr;
+    }
+
+    // Returns where document doc starts, as "file:line".
+    string location(uint32_t doc) const
+    {
+        if (doc >= header->num_docs || docs[doc].file >= header->num_files)
+            throw runtime_error("the index is damaged: a document is outside the file");
+        return string(name(files[docs[doc].file])) + ":" + to_string(docs[doc].line);
+    }
+}; // class Word_index
+
+//
+// Steps through the documents in a word's posting list, in order.
+//
+class Postings_cursor
+{
+    const Word_entry *word;
+    const Skip *skips;
+    const uint8_t *blocks;
+    uint32_t block = 0;
+    uint32_t left_in_block = 0; // after the current document
+    const uint8_t *end; // the end of the file
+    const uint8_t *p = nullptr;
+    const uint8_t *positions_start = nullptr;
+    uint32_t num_positions = 0;
+
+    void decode()
+    {
+        doc += read_varint(p);
+        num_positions = read_varint(p);
+        uint32_t num_bytes = read_varint(p);
+        // each position takes at least one byte
+        if (p > end || num_bytes > end - p || num_positions > num_bytes)
+            throw runtime_error("the index is damaged: a posting list is outside the file");
+        positions_start = p;
+        p += num_bytes;
+    }
+
+    void load_block(uint32_t b)
+    {
+        block = b;
+        p = blocks + skips[b].offset;
+        doc = (b == 0) ? 0 : skips[b - 1].last_doc;
+        left_in_block = min(block_size, word->num_docs - b * block_size) - 1;
+        decode();
+    }
+
+public:
+    uint32_t doc = 0;
+    bool done = false;
+
+    Postings_cursor(const Word_index &index, const Word_entry *word)
+        : word(word), end(index.postings + index.postings_size())
+    {
+        // the skip table must be in the file, and so must the start of each
+        // block; decode checks the rest
+        const uint64_t size = index.postings_size();
+        if (word->postings_offset % 4 != 0 || word->postings_offset > size ||
+            word->num_blocks != (uint64_t(word->num_docs) + block_size - 1) / block_size ||
+            word->num_blocks > (size - word->postings_offset) / sizeof(Skip))
+            throw runtime_error("the index is damaged: a posting list is outside the file");
+        skips = reinterpret_cast<const Skip *>(index.postings + word->postings_offset);
+        blocks = reinterpret_cast<const uint8_t *>(skips + word->num_blocks);
+        for (uint32_t b = 0; b < word->num_blocks; b++)
+        {
+            if (skips[b].offset >= end - blocks)
+                throw runtime_error("the index is damaged: a posting list is outside the file");
+        }
+        if (word->num_docs == 0)
+            done = true;
+        else
+            load_block(0);
+    }
+
+    uint32_t num_docs() const { return word->num_docs; }
+
+    void next()
+    {
+        if (left_in_block > 0)
+        {
+            left_in_block--;
+            decode();
+        }
+        else if (block + 1 < word->num_blocks)
+        {
+            load_block(block + 1);
+        }
+        else
+        {
+            done = true;
+        }
+    }
+
+    // Moves to the first document >= target, using galloping search on the
+    // skip table to find its block.
+    void seek(uint32_t target)
+    {
+        if (done || doc >= target)
+            return;
+        if (skips[block].last_doc < target)
+        {
+            // skips[low] < target, and the block is in (low, high]
+            uint32_t low = block;
+            uint32_t step = 1;
+            uint32_t high = block + 1;
+            while (high < word->num_blocks && skips[high].last_doc < target)
+            {
+                low = high;
+                step *= 2;
+                high = block + step;
+            }
+            if (high >= word->num_blocks)
+            {
+                high = word->num_blocks - 1;
+                if (skips[high].last_doc < target)
+                {
+                    done = true;
+                    return;
+                }
+            }
+            const Skip *s = lower_bound(skips + low + 1, skips + high + 1, target,
+                                        [](const Skip &s, uint32_t t)
+                                        { return s.last_doc < t; });
+            load_block(s - skips);
+        }
+        while (doc < target)
+            next();
+    }
+
+    // The positions of the word in the current document.
+    void positions(vector<uint32_t> &out) const
+    {
+        out.clear();
+        const uint8_t *q = positions_start;
+        uint32_t position = 0;
+        for (uint32_t i = 0; i < num_positions; i++)
+        {
+            position += read_varint(q);
+            out.push_back(position);
+        }
+    }
+}; // class Postings_cursor
+
+// A word or a phrase in a query.
+struct Term
+{
+    vector<string> words;
+};
+
+// Splits a query into terms. Text in double quotes is a phrase, and so is
+// anything else that turns into more than one word, e.g. "darcy's".
+vector<Term> parse_query(const string &query)
+{
+    vector<Term> terms;
+    size_t i = 0;
+    while (i < query.size())
+    {
+        string_view text;
+        if (query[i] == ' ' || query[i] == '\t')
+        {
+            i++;
+            continue;
+        }
+        else if (query[i] == '"')
+        {
+            size_t end = min(query.find('"', i + 1), query.size());
+            text = string_view(query).substr(i + 1, end - i - 1);
+            i = end + 1;
+        }
+        else
+        {
+            size_t end = min(query.find_first_of(" \t\"", i), query.size());
+            text = string_view(query).substr(i, end - i);
+            i = end;
+        }
+        Term t{words_of(text)};
+        if (!t.words.empty())
+            terms.push_back(t);
+    }
+    return terms;
+}
+
+//
+// Returns the documents that contain every term. The posting lists of all the
+// words are intersected, shortest first, and then each phrase is checked using
+// the positions of its words.
+//
+vector<uint32_t> search(const Word_index &index, const vector<Term> &terms)
+{
+    vector<uint32_t> result;
+    vector<string> names;
+    vector<Postings_cursor> cursors;
+    for (const Term &t : terms)
+    {
+        for (const string &w : t.words)
+        {
+            if (find(names.begin(), names.end(), w) != names.end())
+                continue;
+            const Word_entry *e = index.find(w);
+            if (e == nullptr)
+                return result;
+            names.push_back(w);
+            cursors.emplace_back(index, e);
+        }
+    }
+    if (cursors.empty())
+        return result;
+
+    // the cursor for each word of each phrase
+    vector<vector<int>> phrases;
+    for (const Term &t : terms)
+    {
+        if (t.words.size() < 2)
+            continue;
+        phrases.emplace_back();
+        for (const string &w : t.words)
+        {
+            phrases.back().push_back(find(names.begin(), names.end(), w) - names.begin());
+        }
+    }
+
+    vector<int> order(cursors.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b)
+         { return cursors[a].num_docs() < cursors[b].num_docs(); });
+
+    vector<vector<uint32_t>> positions;
+    Postings_cursor &shortest = cursors[order[0]];
+    while (!shortest.done)
+    {
+        // move every cursor to the target; if one passes it, that's the new
+        // target and the shortest list catches up
+        uint32_t target = shortest.doc;
+        bool all_match = true;
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            Postings_cursor &c = cursors[order[i]];
+            c.seek(target);
+            if (c.done)
+                return result;
+            if (c.doc > target)
+            {
+                shortest.seek(c.doc);
+                all_match = false;
+                break;
+            }
+        }
+        if (!all_match)
+            continue;
+
+        bool phrases_match = true;
+        for (const vector<int> &phrase : phrases)
+        {
+            positions.resize(phrase.size());
+            for (size_t i = 0; i < phrase.size(); i++)
+            {
+                cursors[phrase[i]].positions(positions[i]);
+            }
+            bool found = false;
+            for (uint32_t start : positions[0])
+            {
+                found = true;
+                for (size_t i = 1; i < phrase.size() && found; i++)
+                {
+                    found = binary_search(positions[i].begin(), positions[i].end(), start + i);
+                }
+                if (found)
+                    break;
+            }
+            if (!found)
+            {
+                phrases_match = false;
+                break;
+            }
+        }
+        if (phrases_match)
+            result.push_back(target);
+        shortest.next();
+    }
+    return result;
+} // search
+
+////////////////////////////////////////////////////////////////////////////////
+
+void usage()
+{
+    cout << "Usage: ./word_index build [-o index_file] file1 [file2 ...]\n";
+    cout << "       ./word_index query [-k num_shown] index_file [query ...]\n";
+}
+
+int build(const string &index_fname, const vector<string> &fnames)
+{
+    auto start = chrono::steady_clock::now();
+    Index_builder builder;
+    for (const string &fname : fnames)
+    {
+        cmpt::Mapped_file file(fname);
+        if (file.is_open())
+        {
+            builder.add_file(fname, file.begin(), file.end());
+            continue;
+        }
+
+        // not a regular file, e.g. a pipe or <(cat poem.txt), so read it all
+        // into memory
+        ifstream infile(fname);
+        if (!infile)
+        {
+            cout << "Error: unable to open file \"" << fname << "\"\n";
+            return -1;
+        }
+        string contents(istreambuf_iterator<char>(infile), {});
+        if (infile.bad())
+        {
+            cout << "Error: unable to read file \"" << fname << "\"\n";
+            return -1;
+        }
+        builder.add_file(fname, contents.data(), contents.data() + contents.size());
+    }
+    uint64_t file_size = 0;
+    uint64_t postings_size = 0;
+    if (!builder.write(index_fname, file_size, postings_size))
+    {
+        cout << "Error: unable to write \"" << index_fname << "\"\n";
+        return -1;
+    }
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(end - start).count();
+
+    cout << "indexed " << builder.num_bytes << " bytes (" << builder.num_words << " words, "
+         << builder.num_docs() << " paragraphs) from " << fnames.size()
+         << (fnames.size() == 1 ? " file" : " files") << " in " << seconds << "s:\n";
+    cout << builder.num_bytes / seconds / 1000000 << " MB/s, "
+         << builder.num_words / seconds / 1000000 << " M words/s\n";
+    cout << "wrote " << index_fname << ": " << builder.num_different_words() << " different words, "
+         << file_size << " bytes (" << postings_size << " bytes of postings)\n";
+    return 0;
+}
+
+int query(const string &index_fname, const vector<string> &queries, int num_shown)
+{
+    auto start = chrono::steady_clock::now();
+    string error;
+    Word_index index(index_fname, error);
+    auto end = chrono::steady_clock::now();
+    if (!index.is_open())
+    {
+        cout << "Error: " << error << "\n";
+        return -1;
+    }
+    cout << "opened " << index_fname << " in "
+         << chrono::duration<double, micro>(end - start).count() << " us\n";
+
+    double total_us = 0;
+    int num_queries = 0;
+    auto run = [&](const string &q)
+    {
+        auto start = chrono::steady_clock::now();
+        vector<uint32_t> docs = search(index, parse_query(q));
+        auto end = chrono::steady_clock::now();
+        double us = chrono::duration<double, micro>(end - start).count();
+        total_us += us;
+        num_queries++;
+
+        cout << q << ": " << docs.size() << (docs.size() == 1 ? " paragraph (" : " paragraphs (")
+             << us << " us)\n";
+        for (size_t i = 0; i < docs.size() && int(i) < num_shown; i++)
+        {
+            cout << "  " << index.location(docs[i]) << "\n";
+        }
+    };
+
+    try
+    {
+        if (!queries.empty())
+        {
+            for (const string &q : queries)
+                run(q);
+        }
+        else
+        {
+            string q;
+            while (getline(cin, q))
+                run(q);
+        }
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Error: " << e.what() << "\n";
+        return -1;
+    }
+    if (num_queries > 0)
+        cout << num_queries << (num_queries == 1 ? " query: " : " queries: ")
+             << total_us / num_queries << " us average\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return -1;
+    }
+    string command = argv[1];
+    string index_fname = "word_index.idx";
+    int num_shown = 10;
+    vector<string> args;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if ((arg == "-o" && command == "build") || (arg == "-k" && command == "query"))
+        {
+            i++;
+            string value = i < argc ? argv[i] : "";
+            if (arg == "-o")
+            {
+                index_fname = value;
+            }
+            else if (value.empty() || value.size() > 9 ||
+                     value.find_first_not_of("0123456789") != string::npos)
+            {
+                cout << "Invalid value for " << arg << ": \"" << value << "\"\n";
+                usage();
+                return -1;
+            }
+            else
+            {
+                num_shown = stoi(value);
+            }
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    if (command == "build" && !args.empty() && !index_fname.empty())
+        return build(index_fname, args);
+    if (command == "query" && !args.empty())
+        return query(args[0], vector<string>(args.begin() + 1, args.end()), num_shown);
+    usage();
+    return -1;
+}
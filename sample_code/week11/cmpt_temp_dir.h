@@ -0,0 +1,209 @@
+// cmpt_temp_dir.h
+
+// By defining CMPT_TEMP_DIR_H, we avoid problems caused by including this
+// file more than once: if CMPT_TEMP_DIR_H is already defined, then the code
+// is *not* included.
+#ifndef CMPT_TEMP_DIR_H
+#define CMPT_TEMP_DIR_H
+
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cmpt
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    // Temp_dir makes a new, empty directory under $TMPDIR (or /tmp) for
+    // temporary files, and removes it, along with every file in it, when the
+    // Temp_dir is destroyed. For example:
+    //
+    //     cmpt::Temp_dir dir("mysort");           // e.g. /tmp/mysort.a8Xk2Q
+    //     std::ofstream out(dir.file("run1.txt"));
+    //
+    // A destructor doesn't run when a program is killed by a signal, e.g. by
+    // Ctrl-C (SIGINT), by kill (SIGTERM), or by writing to a pipe whose reader
+    // has quit (SIGPIPE, as in ./mysort big.txt | head). So Temp_dir also
+    // catches SIGINT, SIGTERM, SIGHUP and SIGPIPE, and the handler removes
+    // the files of every Temp_dir that exists and then lets the signal kill
+    // the program as it normally would. Signals that have been set to be
+    // ignored (e.g. SIGHUP under nohup) stay ignored.
+    //
+    // A signal handler can interrupt the program anywhere, even in the middle
+    // of a call to new, and so it may only call a short list of "async-signal-
+    // safe" functions, which doesn't include anything that allocates memory.
+    // So everything the handler needs is set up ahead of time: each Temp_dir
+    // has a slot in a fixed-size array with its path and an open file
+    // descriptor for the directory, and the handler lists the directory with
+    // the getdents64 system call into a fixed-size buffer.
+    //
+    // Only regular files directly in the directory are removed.
+    //
+    ////////////////////////////////////////////////////////////////////////////
+    class Temp_dir
+    {
+        // the most Temp_dirs that can exist at once
+        static const int max_dirs = 8;
+
+        struct Slot
+        {
+            volatile std::sig_atomic_t in_use;
+            int fd;
+            char path[PATH_MAX];
+        };
+
+        // C++17 inline variables, so there's just one of each in a program
+        inline static Slot slots[max_dirs];
+        inline static bool handlers_set = false;
+
+        int slot = -1;
+        std::string dir;
+
+        // Removes the files in the directory of slot s, and the directory
+        // itself. This is called by the signal handler, and so only uses
+        // async-signal-safe functions.
+        static void remove_all(const Slot &s)
+        {
+            // the start of a Linux struct linux_dirent64: the name is after
+            // the d_type byte, i.e. 19 bytes in
+            struct Dirent_head
+            {
+                uint64_t d_ino;
+                int64_t d_off;
+                unsigned short d_reclen;
+                unsigned char d_type;
+            };
+            const int name_offset = 19;
+
+            alignas(Dirent_head) char buf[4096];
+            bool removed_any = true;
+            while (removed_any)
+            {
+                // start again after removing files, since removing entries
+                // while reading a directory may make it skip some
+                removed_any = false;
+                lseek(s.fd, 0, SEEK_SET);
+                long n;
+                while ((n = syscall(SYS_getdents64, s.fd, buf, sizeof(buf))) > 0)
+                {
+                    for (long pos = 0; pos < n;)
+                    {
+                        const Dirent_head *d = reinterpret_cast<const Dirent_head *>(buf + pos);
+                        const char *name = buf + pos + name_offset;
+                        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0 &&
+                            unlinkat(s.fd, name, 0) == 0)
+                            removed_any = true;
+                        pos += d->d_reclen;
+                    }
+                }
+            }
+            rmdir(s.path);
+        }
+
+        static void on_signal(int sig)
+        {
+            for (int i = 0; i < max_dirs; i++)
+            {
+                if (slots[i].in_use)
+                    remove_all(slots[i]);
+            }
+
+            // the signal is blocked until this handler returns, and then it
+            // does what it would have done without the handler
+            signal(sig, SIG_DFL);
+            raise(sig);
+        }
+
+        static void set_handlers()
+        {
+            if (handlers_set)
+                return;
+            handlers_set = true;
+            for (int sig : {SIGINT, SIGTERM, SIGHUP, SIGPIPE})
+            {
+                struct sigaction old_action;
+                sigaction(sig, nullptr, &old_action);
+                if (old_action.sa_handler != SIG_DFL)
+                    continue; // ignored, or handled by the program
+
+                struct sigaction action;
+                memset(&action, 0, sizeof(action));
+                action.sa_handler = on_signal;
+                sigemptyset(&action.sa_mask);
+                sigaction(sig, &action, nullptr);
+            }
+        }
+
+    public:
+        // Makes a directory named like prefix.XXXXXX, where the Xs are
+        // replaced to make a name that isn't already used. Throws a
+        // runtime_error if the directory can't be made.
+        Temp_dir(const std::string &prefix)
+        {
+            const char *tmp = getenv("TMPDIR");
+            std::string pattern = std::string(tmp != nullptr ? tmp : "/tmp") + "/" + prefix + ".XXXXXX";
+            if (pattern.size() >= PATH_MAX)
+                throw std::runtime_error("temporary directory name is too long: " + pattern);
+
+            for (int i = 0; i < max_dirs && slot == -1; i++)
+            {
+                if (!slots[i].in_use)
+                    slot = i;
+            }
+            if (slot == -1)
+                throw std::runtime_error("too many temporary directories");
+
+            std::vector<char> buf(pattern.begin(), pattern.end());
+            buf.push_back('\0');
+            if (mkdtemp(buf.data()) == nullptr)
+                throw std::runtime_error("unable to create a temporary directory from " + pattern);
+            dir = buf.data();
+
+            int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (fd == -1)
+            {
+                rmdir(dir.c_str());
+                throw std::runtime_error("unable to open temporary directory " + dir);
+            }
+
+            // fill in the slot before marking it as used, so the handler never
+            // sees half of it
+            set_handlers();
+            slots[slot].fd = fd;
+            strcpy(slots[slot].path, dir.c_str());
+            slots[slot].in_use = 1;
+        }
+
+        ~Temp_dir()
+        {
+            // if a signal comes in the middle of this, the handler removes
+            // whatever is left
+            remove_all(slots[slot]);
+            slots[slot].in_use = 0;
+            close(slots[slot].fd);
+        }
+
+        // A Temp_dir owns its directory, so copying is not allowed.
+        Temp_dir(const Temp_dir &other) = delete;
+        Temp_dir &operator=(const Temp_dir &other) = delete;
+
+        // Returns the path of the directory.
+        const std::string &name() const { return dir; }
+
+        // Returns the path of a file named fname in the directory. The file
+        // isn't created.
+        std::string file(const std::string &fname) const { return dir + "/" + fname; }
+    }; // class Temp_dir
+
+} // namespace cmpt
+
+#endif
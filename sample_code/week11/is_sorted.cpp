@@ -9,9 +9,42 @@
 //   > ./is_sorted < words.txt
 //   The words are in sorted order.
 //
+// If a file name is given, then the *lines* of the file are checked instead,
+// and the file is memory-mapped (see cmpt_mapped_file.h) rather than copied
+// into strings. The file is split into chunks at line boundaries, and the
+// chunks are checked in parallel on -j threads (default: the number of
+// hardware threads). Each chunk compares its first line with the last line of
+// the chunk before it, so out-of-order lines at the seam between two chunks
+// are found too. Lines are compared byte by byte, like LC_ALL=C sort.
+//
+// By default only the first out-of-order line is reported, and the check stops
+// as soon as it is found. With --all, every out-of-order line is reported:
+//
+//   > ./is_sorted ospd_sorted.txt
+//   The lines ARE in sorted order.
+//
+//   > ./is_sorted --all small.txt
+//   The lines are NOT in sorted order (3 lines out of order):
+//     line 1 "zoo" should come after line 2 "ask"
+//     line 3 "cow" should come after line 4 "bird"
+//     line 5 "nose" should come after line 6 "dog"
+//
+// In the file mode the exit code is 0 if the lines are sorted, 1 if they are
+// not, and 2 if there is an error, so it can be used in scripts.
+//
 
+#include "cmpt_mapped_file.h"
+#include "cmpt_tokenizer.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -21,13 +54,213 @@ string quote(const string &s)
     return "\"" + s + "\"";
 }
 
-int main()
+string quote(string_view s)
+{
+    return quote(string(s));
+}
+
+// A pair of adjacent lines that are in the wrong order. line_num is the line
+// number of current, and previous is on the line before it.
+struct Violation
+{
+    long long line_num;
+    string_view previous;
+    string_view current;
+};
+
+// The result of checking one chunk. line_num in each violation is counted from
+// the start of the chunk, and is fixed up once all chunks are done.
+struct Chunk_result
+{
+    long long num_lines = 0;
+    vector<Violation> violations;
+};
+
+// Returns the line that ends just before begin, which must be the start of a
+// line after the first one in the file.
+string_view line_before(const char *file_begin, const char *begin)
+{
+    const char *end = begin - 1; // the '\n' at the end of the line before
+    const char *start = end;
+    while (start != file_begin && start[-1] != '\n')
+    {
+        start--;
+    }
+    return string_view(start, end - start);
+}
+
+//
+// Checks the lines from begin up to, but not including, end. begin must be the
+// start of a line, and the first line is compared with the line before it in
+// the file (if any). If all is false, it stops after the first violation.
+//
+Chunk_result check_chunk(const char *file_begin, const char *begin, const char *end, bool all)
+{
+    Chunk_result result;
+    bool has_previous = (begin != file_begin);
+    string_view previous;
+    if (has_previous)
+        previous = line_before(file_begin, begin);
+
+    cmpt::Tokenizer lines(begin, end, cmpt::Tokenizer::lines);
+    string_view current;
+    while (lines.next(current))
+    {
+        result.num_lines++;
+
+        if (has_previous && current < previous)
+        {
+            result.violations.push_back({result.num_lines, previous, current});
+            if (!all)
+                return result;
+        }
+        previous = current;
+        has_previous = true;
+    }
+    return result;
+} // check_chunk
+
+// Returns the chunk boundaries for the characters from begin to end. Each
+// chunk is about chunk_size bytes, and every boundary after the first is just
+// after a '\n'.
+vector<const char *> chunk_boundaries(const char *begin, const char *end, size_t chunk_size)
+{
+    vector<const char *> boundaries = {begin};
+    const char *p = begin;
+    while (end - p > chunk_size)
+    {
+        const char *newline = static_cast<const char *>(memchr(p + chunk_size, '\n', end - p - chunk_size));
+        if (newline == nullptr || newline + 1 == end)
+            break;
+        p = newline + 1;
+        boundaries.push_back(p);
+    }
+    boundaries.push_back(end);
+    return boundaries;
+}
+
+//
+// Checks the lines from begin to end on num_threads threads, and returns the
+// violations with their line numbers counted from the start of the file. If
+// all is false, only the first violation is returned.
+//
+// Threads take chunks in order, so when all is false a thread can skip any
+// chunk after one that is already known to have a violation. The chunks
+// before it are always finished, and have no violations of their own if they
+// come before the first violation, so their line counts are complete.
+//
+vector<Violation> check_lines(const char *begin, const char *end, bool all, int num_threads)
+{
+    const size_t chunk_size = max<size_t>(1 << 20, (end - begin) / (8 * num_threads) + 1);
+    vector<const char *> boundaries = chunk_boundaries(begin, end, chunk_size);
+    const int num_chunks = boundaries.size() - 1;
+
+    vector<Chunk_result> results(num_chunks);
+    atomic<int> next_chunk(0);
+    atomic<int> first_bad_chunk(num_chunks);
+    auto worker = [&]() {
+        for (int i = next_chunk++; i < num_chunks; i = next_chunk++)
+        {
+            if (!all && i > first_bad_chunk)
+                continue;
+            results[i] = check_chunk(begin, boundaries[i], boundaries[i + 1], all);
+            if (!results[i].violations.empty())
+            {
+                int bad = first_bad_chunk;
+                while (i < bad && !first_bad_chunk.compare_exchange_weak(bad, i))
+                {
+                }
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < min(num_threads, num_chunks); t++)
+    {
+        threads.push_back(thread(worker));
+    }
+    worker();
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+
+    vector<Violation> violations;
+    long long lines_before = 0;
+    for (int i = 0; i < num_chunks; i++)
+    {
+        for (Violation v : results[i].violations)
+        {
+            v.line_num += lines_before;
+            violations.push_back(v);
+            if (!all)
+                return violations;
+        }
+        lines_before += results[i].num_lines;
+    }
+    return violations;
+} // check_lines
+
+void print_violations(const vector<Violation> &violations, bool all)
+{
+    if (violations.empty())
+    {
+        cout << "The lines ARE in sorted order.\n";
+        return;
+    }
+
+    cout << "The lines are NOT in sorted order";
+    if (all)
+        cout << " (" << violations.size() << " lines out of order)";
+    cout << ":\n";
+    for (const Violation &v : violations)
+    {
+        cout << "  line " << v.line_num - 1 << " " << quote(v.previous)
+             << " should come after line " << v.line_num << " " << quote(v.current) << "\n";
+    }
+}
+
+// Checks the lines of fname. Returns the exit code for main.
+int check_file(const string &fname, bool all, int num_threads)
+{
+    cmpt::Mapped_file file(fname);
+    if (file.is_open())
+    {
+        vector<Violation> violations = check_lines(file.begin(), file.end(), all, num_threads);
+        print_violations(violations, all);
+        return violations.empty() ? 0 : 1;
+    }
+
+    // not a regular file, e.g. a pipe, so read it all into memory
+    ifstream infile(fname);
+    if (!infile)
+    {
+        cout << "Error: unable to open file " << quote(fname) << "\n";
+        return 2;
+    }
+    string contents(istreambuf_iterator<char>(infile), {});
+    const char *begin = contents.data();
+    vector<Violation> violations = check_lines(begin, begin + contents.size(), all, num_threads);
+    print_violations(violations, all);
+    return violations.empty() ? 0 : 1;
+}
+
+void usage()
+{
+    cout << "Usage: ./is_sorted < words.txt\n";
+    cout << "       ./is_sorted [-j num_threads] [--all] filename\n";
+}
+
+int check_words()
 {
     // Read one word at a time from cin. If the current word is alphabetically
-    // before the previous one, then they are not in sorted order.
+    // before the previous one, then they are not in sorted order. cin is read
+    // in blocks, so current is only valid until the next word is read, and
+    // previous has to be a copy.
+    cmpt::Tokenizer words(0, cmpt::Tokenizer::words);
     string previous;
-    string current;
-    while (cin >> current)
+    string_view current;
+    while (words.next(current))
     {
         if (current < previous)
         {
@@ -38,4 +271,53 @@ int main()
         previous = current;
     }
     cout << "The lines ARE in sorted order.\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 1)
+        return check_words();
+
+    bool all = false;
+    int num_threads = max(1u, thread::hardware_concurrency());
+    string fname;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--all")
+        {
+            all = true;
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            string value = argv[++i];
+            num_threads = 0;
+            if (!value.empty() && value.size() <= 4 &&
+                all_of(value.begin(), value.end(), [](char c) { return isdigit(c); }))
+                num_threads = stoi(value);
+            if (num_threads < 1 || num_threads > 1024)
+            {
+                cout << "Error: invalid number of threads " << quote(value) << "\n";
+                usage();
+                return 2;
+            }
+        }
+        else if (fname.empty() && arg[0] != '-')
+        {
+            fname = arg;
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    if (fname.empty())
+    {
+        usage();
+        return 2;
+    }
+    return check_file(fname, all, num_threads);
 }
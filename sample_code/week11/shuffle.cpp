@@ -8,48 +8,311 @@
 //
 //   > ./shuffle < words.txt > shuffled.txt
 //
+// If a file name is given, then the *lines* of the file are shuffled instead:
+//
+//   > ./shuffle ospd_sorted.txt > shuffled.txt
+//
+// Every order is equally likely. The words or lines are never copied into
+// separate strings: the input is read (or memory-mapped) once, and a table of
+// string_views pointing into it is shuffled using the Fisher-Yates algorithm
+// with a fast random number generator. --seed n gives the generator a fixed
+// seed, so the same input and seed always give the same output.
+//
+// Out-of-Core Shuffling
+// ---------------------
+// If the file is bigger than --memory-limit (e.g. --memory-limit 500M), then it
+// is shuffled in two passes. The first pass reads the file line by line and
+// appends each line to a randomly chosen bucket file in a temporary directory
+// (in $TMPDIR, or /tmp). There are enough buckets that each one fits in the
+// memory limit. The second pass reads the buckets back one at a time, shuffles
+// each one in memory, and writes it out. Each line is equally likely to land in
+// any bucket, and each bucket is shuffled fairly, so every order of the whole
+// file is still equally likely.
+//
+// If the file isn't a regular file, e.g. it's a pipe or <(cat big.txt), then
+// its size can't be known in advance. It's read into memory until it passes
+// the memory limit, and if it does the rest of it is copied to a temporary
+// file, which is then shuffled in two passes as above.
+//
+// The temporary directory is removed when shuffle is done, and also if it's
+// killed by Ctrl-C, by kill, or by writing to a closed pipe, as in
+// ./shuffle --memory-limit 500M big.txt | head (see cmpt_temp_dir.h).
+//
 
+#include "cmpt_mapped_file.h"
+#include "cmpt_random.h"
+#include "cmpt_size.h"
+#include "cmpt_temp_dir.h"
+#include "cmpt_tokenizer.h"
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
 
-// Randomly re-arrange the elements of a vector of strings.
-void shuffle(vector<string> &words)
+// Randomly re-arrange the elements of v using the Fisher-Yates algorithm:
+// v[i] is swapped with a random element from v[0] to v[i], for i from the end
+// down to 1.
+template <class T>
+void shuffle(vector<T> &v, cmpt::Random &rng)
 {
-    for (int i = 0; i < words.size(); i++)
+    for (size_t i = v.size(); i > 1; i--)
     {
-        // choose a random index j
-        int j = rand() % words.size();
+        swap(v[i - 1], v[rng.below(i)]);
+    }
+}
 
-        // swap words[i] and words[j]
-        swap(words[i], words[j]); 
-        // string temp = words[i];
-        // words[i] = words[j];
-        // words[j] = temp;
+// Returns all the tokens from in. They must stay valid, i.e. in must be reading
+// from memory or from a mapped file.
+vector<string_view> read_tokens(cmpt::Tokenizer &in)
+{
+    vector<string_view> tokens;
+    string_view token;
+    while (in.next(token))
+    {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+void print_lines(const vector<string_view> &lines, ostream &out)
+{
+    for (string_view line : lines)
+    {
+        out << line << "\n";
     }
 }
 
-int main()
+// Shuffle the lines from begin to end and write them to out.
+void shuffle_lines(const char *begin, const char *end, cmpt::Random &rng, ostream &out)
 {
-    // set random seed so random numbers are different each time
-    srand(time(NULL));
+    cmpt::Tokenizer in(begin, end, cmpt::Tokenizer::lines);
+    vector<string_view> lines = read_tokens(in);
+    shuffle(lines, rng);
+    print_lines(lines, out);
+}
+
+//
+// A temporary directory that holds the bucket files. The directory and the
+// files in it are removed when the Bucket_dir is destroyed, or if shuffle is
+// killed by a signal (see cmpt_temp_dir.h).
+//
+class Bucket_dir
+{
+    cmpt::Temp_dir dir{"shuffle"};
+    vector<string> bucket_fnames;
 
-    // read in the words from cin
-    vector<string> words;
-    string w;
-    while (cin >> w)
+public:
+    Bucket_dir(int num_buckets)
     {
-        words.push_back(w);
+        for (int i = 0; i < num_buckets; i++)
+        {
+            bucket_fnames.push_back(dir.file("bucket" + to_string(i + 1) + ".txt"));
+        }
     }
 
-    // randomly re-arrange them
-    shuffle(words);
+    int size() const { return bucket_fnames.size(); }
+    const string &operator[](int i) const { return bucket_fnames[i]; }
+}; // class Bucket_dir
+
+//
+// Shuffle the lines of infile, which is file_size bytes, using at most about
+// memory_limit bytes of memory. See "Out-of-Core Shuffling" at the top of the
+// file.
+//
+void shuffle_external(const string &fname, long long file_size, long long memory_limit,
+                      cmpt::Random &rng, ostream &out)
+{
+    // Each bucket gets about 1/num_buckets of the file. Shuffling a bucket
+    // needs its text plus a 16-byte string_view per line, so the buckets are
+    // made about half the memory limit to leave room for the table.
+    const long long bucket_size = max(1LL, memory_limit / 2);
+    const long long num_buckets = file_size / bucket_size + 1;
+    const int max_buckets = 1000; // each bucket is an open file in pass 1
+    if (num_buckets > max_buckets)
+        throw runtime_error("the memory limit is too small for a file this big");
+
+    Bucket_dir buckets(num_buckets);
+
+    // pass 1: scatter the lines into random buckets
+    {
+        vector<ofstream> bucket_files(buckets.size());
+        for (int i = 0; i < buckets.size(); i++)
+        {
+            bucket_files[i].open(buckets[i]);
+        }
+
+        // the file is read in blocks rather than mapped, so that the pages
+        // that have been read don't use up memory
+        cmpt::Tokenizer infile(fname, cmpt::Tokenizer::lines, false);
+        string_view line;
+        while (infile.next(line))
+        {
+            bucket_files[rng.below(buckets.size())] << line << "\n";
+        }
+
+        for (int i = 0; i < buckets.size(); i++)
+        {
+            bucket_files[i].close();
+            if (!bucket_files[i])
+                throw runtime_error("unable to write temporary file " + buckets[i]);
+        }
+    }
 
-    // write them to cout
-    for (string w : words)
+    // pass 2: shuffle each bucket in memory
+    for (int i = 0; i < buckets.size(); i++)
+    {
+        cmpt::Mapped_file bucket(buckets[i]);
+        if (!bucket.is_open())
+            throw runtime_error("unable to read temporary file " + buckets[i]);
+        shuffle_lines(bucket.begin(), bucket.end(), rng, out);
+        if (!out)
+            throw runtime_error("unable to write the shuffled lines");
+    }
+} // shuffle_external
+
+//
+// Shuffle the lines read from in, which isn't a regular file (e.g. it's a
+// pipe), so its size isn't known until it has all been read. The input is read
+// into memory until it is bigger than memory_limit (if memory_limit isn't 0).
+// If it all fits, it's shuffled in memory; otherwise what was read and the rest
+// of in are copied to a temporary file, which is then shuffled by
+// shuffle_external.
+//
+void shuffle_stream(istream &in, long long memory_limit, cmpt::Random &rng, ostream &out)
+{
+    string contents;
+    vector<char> block(1 << 16);
+    while ((memory_limit == 0 || contents.size() <= memory_limit) &&
+           (in.read(block.data(), block.size()) || in.gcount() > 0))
+    {
+        contents.append(block.data(), in.gcount());
+    }
+    if (memory_limit == 0 || contents.size() <= memory_limit)
+    {
+        shuffle_lines(contents.data(), contents.data() + contents.size(), rng, out);
+        return;
+    }
+
+    cmpt::Temp_dir dir("shuffle");
+    const string fname = dir.file("input.txt");
+    ofstream copy(fname, ios::binary);
+    long long size = contents.size();
+    copy.write(contents.data(), contents.size());
+    string().swap(contents); // free the memory before the buckets are shuffled
+    while (in.read(block.data(), block.size()) || in.gcount() > 0)
+    {
+        copy.write(block.data(), in.gcount());
+        size += in.gcount();
+    }
+    copy.close();
+    if (!copy)
+        throw runtime_error("unable to write temporary file " + fname);
+
+    shuffle_external(fname, size, memory_limit, rng, out);
+} // shuffle_stream
+
+void usage()
+{
+    cout << "Usage: ./shuffle [--seed n] < words.txt\n";
+    cout << "       ./shuffle [--seed n] [--memory-limit size] filename\n";
+}
+
+int main(int argc, char *argv[])
+{
+    // cout is only used through C++ streams, so it needn't stay in step with C
+    // stdio; this makes writing lots of short lines much faster
+    ios_base::sync_with_stdio(false);
+
+    // by default, use a different random seed each time
+    uint64_t seed = random_device()() ^ static_cast<uint64_t>(time(NULL));
+    long long memory_limit = 0;
+    string fname;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc)
+        {
+            string value = argv[++i];
+            if (value.empty() || value.find_first_not_of("0123456789") != string::npos ||
+                value.size() > 19)
+            {
+                cout << "Error: invalid seed \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+            seed = stoull(value);
+        }
+        else if (arg == "--memory-limit" && i + 1 < argc)
+        {
+            string value = argv[++i];
+            memory_limit = cmpt::parse_size(value);
+            if (memory_limit == 0)
+            {
+                cout << "Error: invalid memory limit \"" << value << "\"\n";
+                usage();
+                return 1;
+            }
+        }
+        else if (fname.empty() && arg[0] != '-')
+        {
+            fname = arg;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    cmpt::Random rng(seed);
+
+    if (fname.empty())
+    {
+        // read all of cin, and shuffle its words
+        string contents(istreambuf_iterator<char>(cin), {});
+        cmpt::Tokenizer in(contents.data(), contents.data() + contents.size(), cmpt::Tokenizer::words);
+        vector<string_view> words = read_tokens(in);
+        shuffle(words, rng);
+        print_lines(words, cout);
+        return 0;
+    }
+
+    try
+    {
+        cmpt::Mapped_file file(fname);
+        if (file.is_open() && (memory_limit == 0 || file.size() <= memory_limit))
+        {
+            shuffle_lines(file.begin(), file.end(), rng, cout);
+            return 0;
+        }
+
+        ifstream infile(fname);
+        if (!infile)
+        {
+            cout << "Error: unable to open file \"" << fname << "\"\n";
+            return 1;
+        }
+        if (file.is_open())
+        {
+            shuffle_external(fname, file.size(), memory_limit, rng, cout);
+        }
+        else
+        {
+            // not a regular file, e.g. a pipe
+            shuffle_stream(infile, memory_limit, rng, cout);
+        }
+    }
+    catch (const runtime_error &e)
     {
-        cout << w << "\n";
+        cout << "Error: " << e.what() << "\n";
+        return 1;
     }
 }
@@ -1,11 +1,13 @@
 // binary_search.cpp
 
+#include "cmpt_tokenizer.h"
 #include <cassert>
 #include <cstdio>
 #include <ctime>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
@@ -169,12 +171,12 @@ string quote(const string &s)
 
 vector<string> load_dictionary(const string &filename)
 {
-    ifstream infile(filename);
+    cmpt::Tokenizer infile(filename, cmpt::Tokenizer::words);
     vector<string> dict;
-    string w;
-    while (infile >> w)
+    string_view w;
+    while (infile.next(w))
     {
-        dict.push_back(w);
+        dict.push_back(string(w));
     }
     const int n = dict.size();
     cout << n << " words loaded from " << filename << "\n";
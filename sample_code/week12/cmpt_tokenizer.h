@@ -0,0 +1,235 @@
+// cmpt_tokenizer.h
+
+// By defining CMPT_TOKENIZER_H, we avoid problems caused by including this
+// file more than once: if CMPT_TOKENIZER_H is already defined, then the code
+// is *not* included.
+#ifndef CMPT_TOKENIZER_H
+#define CMPT_TOKENIZER_H
+
+#include "cmpt_mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cmpt
+{
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    // Tokenizer splits text into words or lines, and returns each one as a
+    // string_view instead of copying it into a string. For example:
+    //
+    //     cmpt::Tokenizer in("ospd.txt", cmpt::Tokenizer::words);
+    //     std::string_view w;
+    //     while (in.next(w))
+    //     {
+    //         // ... use w ...
+    //     }
+    //
+    // Words are separated by whitespace, just like infile >> w. Lines are split
+    // just like getline(infile, line): a '\n' ends a line (and is not part of
+    // it), and the last line doesn't need a '\n'.
+    //
+    // The text can come from:
+    //
+    //  - memory, e.g. a string or part of a file that's already mapped
+    //  - a file, which is memory-mapped (see cmpt_mapped_file.h) if possible
+    //  - an open file descriptor, e.g. 0 for cin, which is read in big blocks
+    //    with the read system call (like cmpt::Block_reader)
+    //
+    // When the text is in memory or mapped, the tokens point right into it and
+    // stay valid as long as the Tokenizer does; tokens_stay_valid() returns
+    // true. When the text is read in blocks, a token is only valid until the
+    // next call to next(), so copy it (e.g. into a string) to keep it.
+    //
+    ////////////////////////////////////////////////////////////////////////////
+    class Tokenizer
+    {
+    public:
+        enum Kind
+        {
+            words,
+            lines
+        };
+
+    private:
+        Kind kind;
+        std::unique_ptr<Mapped_file> file;
+        int fd = -1;
+        bool owns_fd = false;
+        bool opened = false;
+        bool at_eof = true; // true when there's nothing more to read
+        std::vector<char> buffer;
+
+        // the unread text is from pos to end
+        const char *pos = nullptr;
+        const char *end = nullptr;
+
+        static bool is_space(char c)
+        {
+            // ' ', or one of '\t', '\n', '\v', '\f', '\r'
+            return c == ' ' || (c >= '\t' && c <= '\r');
+        }
+
+        // Reads the next block of the file. The text from keep to end is
+        // moved to the start of the buffer first (the buffer grows if it's
+        // full), so the token that starts at keep is still all in one place.
+        // keep and pos are updated to point to the moved text. Returns false
+        // if there's nothing more to read.
+        bool read_more(const char *&keep)
+        {
+            if (at_eof)
+                return false;
+
+            const size_t kept = end - keep;
+            const size_t pos_offset = pos - keep;
+            if (kept > 0 && keep != buffer.data())
+                memmove(buffer.data(), keep, kept);
+            if (kept == buffer.size())
+                buffer.resize(2 * buffer.size());
+
+            ssize_t n;
+            do
+            {
+                n = read(fd, buffer.data() + kept, buffer.size() - kept);
+            } while (n == -1 && errno == EINTR);
+
+            keep = buffer.data();
+            pos = keep + pos_offset;
+            end = keep + kept + (n > 0 ? n : 0);
+            if (n <= 0)
+            {
+                at_eof = true;
+                return false;
+            }
+            return true;
+        }
+
+        bool next_line(std::string_view &token)
+        {
+            const char *start = pos;
+            for (;;)
+            {
+                const void *newline = (pos == end) ? nullptr : memchr(pos, '\n', end - pos);
+                if (newline != nullptr)
+                {
+                    pos = static_cast<const char *>(newline);
+                    token = std::string_view(start, pos - start);
+                    pos++;
+                    return true;
+                }
+                pos = end;
+                if (!read_more(start))
+                {
+                    if (start == end)
+                        return false;
+                    token = std::string_view(start, end - start);
+                    return true;
+                }
+            }
+        }
+
+        bool next_word(std::string_view &token)
+        {
+            // skip whitespace
+            for (;;)
+            {
+                while (pos != end && is_space(*pos))
+                    pos++;
+                if (pos != end)
+                    break;
+                const char *keep = pos;
+                if (!read_more(keep))
+                    return false;
+            }
+
+            const char *start = pos;
+            for (;;)
+            {
+                while (pos != end && !is_space(*pos))
+                    pos++;
+                if (pos != end || !read_more(start))
+                    break;
+            }
+            token = std::string_view(start, pos - start);
+            return true;
+        }
+
+    public:
+        // Tokens from the characters from begin up to, but not including, end.
+        Tokenizer(const char *begin, const char *end, Kind kind)
+            : kind(kind), opened(true), pos(begin), end(end)
+        {
+        }
+
+        // Tokens from the already-open file fd, read in blocks of block_size
+        // bytes. fd is not closed.
+        Tokenizer(int fd, Kind kind, size_t block_size = 1 << 20)
+            : kind(kind), fd(fd), opened(true), at_eof(false), buffer(block_size)
+        {
+        }
+
+        // Tokens from the file named fname. If map is true and the file can
+        // be memory-mapped then it is, and otherwise it is read in blocks.
+        // is_open() is false if the file can't be opened.
+        Tokenizer(const std::string &fname, Kind kind, bool map = true)
+            : kind(kind)
+        {
+            fd = open(fname.c_str(), O_RDONLY);
+            if (fd == -1)
+                return;
+            opened = true;
+
+            if (map)
+            {
+                file.reset(new Mapped_file(fd));
+                if (file->is_open())
+                {
+                    close(fd);
+                    fd = -1;
+                    pos = file->begin();
+                    end = file->end();
+                    return;
+                }
+                file.reset();
+            }
+
+            owns_fd = true;
+            at_eof = false;
+            buffer.resize(1 << 20);
+        }
+
+        ~Tokenizer()
+        {
+            if (owns_fd)
+                close(fd);
+        }
+
+        Tokenizer(const Tokenizer &other) = delete;
+        Tokenizer &operator=(const Tokenizer &other) = delete;
+
+        bool is_open() const { return opened; }
+
+        // true if tokens point into memory that lasts as long as the
+        // Tokenizer, and false if they only last until the next call to next()
+        bool tokens_stay_valid() const { return buffer.empty(); }
+
+        // Sets token to the next word or line and returns true, or returns
+        // false if there are no more.
+        bool next(std::string_view &token)
+        {
+            if (kind == lines)
+                return next_line(token);
+            else
+                return next_word(token);
+        }
+    }; // class Tokenizer
+
+} // namespace cmpt
+
+#endif
@@ -0,0 +1,138 @@
+// tokenize_bench.cpp
+
+//
+// Compares how fast words and lines can be read from a file using infile >> w
+// and getline, and using cmpt::Tokenizer (see cmpt_tokenizer.h) on a
+// memory-mapped file and on a file read in blocks. Each file is read 20 times
+// by each method, and the speed is given in millions of tokens per second:
+//
+//   > ./tokenize_bench ospd.txt ../week1/wordcount/austenPride.txt
+//   ospd.txt:
+//     words infile >> w       :   79339 tokens, 8.95 M tokens/s
+//     words Tokenizer (mapped):   79339 tokens, 11.05 M tokens/s
+//     words Tokenizer (blocks):   79339 tokens, 10.85 M tokens/s
+//     lines getline           :   79339 tokens, 22.91 M tokens/s
+//     lines Tokenizer (mapped):   79339 tokens, 60.63 M tokens/s
+//     lines Tokenizer (blocks):   79339 tokens, 58.89 M tokens/s
+//   ../week1/wordcount/austenPride.txt:
+//     words infile >> w       :  124580 tokens, 10.53 M tokens/s
+//     words Tokenizer (mapped):  124580 tokens, 13.00 M tokens/s
+//     words Tokenizer (blocks):  124580 tokens, 13.61 M tokens/s
+//     lines getline           :   13427 tokens, 23.92 M tokens/s
+//     lines Tokenizer (mapped):   13427 tokens, 38.68 M tokens/s
+//     lines Tokenizer (blocks):   13427 tokens, 35.45 M tokens/s
+//
+// Lines are found with memchr, which is fast even without optimization, so
+// they are 2-3 times faster than getline. Words are found one character at a
+// time, and the makefile doesn't turn on optimization; compiled with -O2 the
+// Tokenizer reads about 33-38 M words/s, against 11-12 M for infile >> w.
+//
+// Every method must find the same number of tokens.
+//
+
+#include "cmpt_tokenizer.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+const int num_repeats = 20;
+
+// Counts the tokens in fname, num_repeats times, and prints the speed. count
+// is a function that returns the number of tokens in fname.
+template <class Count_fn>
+long long time_method(const string &name, const string &fname, Count_fn count)
+{
+    long long num_tokens = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < num_repeats; i++)
+    {
+        num_tokens = count(fname);
+    }
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(end - start).count();
+
+    cout << "  " << name << ": " << setw(7) << num_tokens << " tokens, "
+         << num_repeats * num_tokens / seconds / 1000000 << " M tokens/s\n";
+    return num_tokens;
+}
+
+long long count_with_stream(const string &fname, cmpt::Tokenizer::Kind kind)
+{
+    ifstream infile(fname);
+    long long n = 0;
+    string token;
+    if (kind == cmpt::Tokenizer::words)
+    {
+        while (infile >> token)
+            n++;
+    }
+    else
+    {
+        while (getline(infile, token))
+            n++;
+    }
+    return n;
+}
+
+long long count_with_tokenizer(const string &fname, cmpt::Tokenizer::Kind kind, bool map)
+{
+    cmpt::Tokenizer in(fname, kind, map);
+    long long n = 0;
+    string_view token;
+    while (in.next(token))
+        n++;
+    return n;
+}
+
+// Returns true if all the methods agree.
+bool bench_file(const string &fname)
+{
+    cout << fname << ":\n";
+    bool ok = true;
+    const cmpt::Tokenizer::Kind kinds[] = {cmpt::Tokenizer::words, cmpt::Tokenizer::lines};
+    for (cmpt::Tokenizer::Kind kind : kinds)
+    {
+        string kind_name = (kind == cmpt::Tokenizer::words) ? "words " : "lines ";
+        string stream_name = (kind == cmpt::Tokenizer::words) ? "infile >> w       " : "getline           ";
+        long long expected = time_method(kind_name + stream_name, fname, [&](const string &f)
+                                         { return count_with_stream(f, kind); });
+        long long mapped = time_method(kind_name + "Tokenizer (mapped)", fname, [&](const string &f)
+                                       { return count_with_tokenizer(f, kind, true); });
+        long long blocks = time_method(kind_name + "Tokenizer (blocks)", fname, [&](const string &f)
+                                       { return count_with_tokenizer(f, kind, false); });
+        if (mapped != expected || blocks != expected)
+        {
+            cout << "  !! the methods found different numbers of " << kind_name << "\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cout << "Usage: ./tokenize_bench filename ...\n";
+        return 1;
+    }
+
+    cout << fixed << setprecision(2);
+    bool all_ok = true;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!cmpt::Tokenizer(argv[i], cmpt::Tokenizer::words).is_open())
+        {
+            cout << "Error: unable to open file \"" << argv[i] << "\"\n";
+            return 1;
+        }
+        if (!bench_file(argv[i]))
+            all_ok = false;
+    }
+    return all_ok ? 0 : 1;
+}